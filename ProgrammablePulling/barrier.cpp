@@ -0,0 +1,149 @@
+/*
+ * barrier.cpp
+ *
+ *  Tracking of the buffers written by shaders, to issue the minimal memory barriers between passes
+ */
+
+#include "barrier.h"
+
+#include <cassert>
+
+namespace buddha {
+
+// in the order of BufferAccess
+static const GLbitfield kAccessBarrierBits[NUMBER_OF_BUFFER_ACCESSES] = {
+    GL_SHADER_STORAGE_BARRIER_BIT,
+    GL_SHADER_IMAGE_ACCESS_BARRIER_BIT,
+    GL_TEXTURE_FETCH_BARRIER_BIT,
+    GL_UNIFORM_BARRIER_BIT,
+    GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT,
+    GL_ELEMENT_ARRAY_BARRIER_BIT,
+    GL_TRANSFORM_FEEDBACK_BARRIER_BIT,
+    GL_BUFFER_UPDATE_BARRIER_BIT
+};
+
+static bool IsIncoherentWrite(BufferAccess access)
+{
+    return access == BUFFER_ACCESS_SHADER_STORAGE || access == BUFFER_ACCESS_SHADER_IMAGE;
+}
+
+MemoryBarrierTracker::MemoryBarrierTracker()
+    : mPassName(NULL)
+    , mIsBarrierIssued(false)
+{
+}
+
+void MemoryBarrierTracker::BeginPass(const char* name)
+{
+    assert(!mPassName);
+
+    mPassName = name;
+    mPassAccesses.clear();
+    mIsBarrierIssued = false;
+}
+
+void MemoryBarrierTracker::Read(GLuint buffer, BufferAccess access)
+{
+    assert(mPassName && !mIsBarrierIssued);
+    mPassAccesses.push_back({ buffer, access, false });
+}
+
+void MemoryBarrierTracker::Write(GLuint buffer, BufferAccess access)
+{
+    assert(mPassName && !mIsBarrierIssued);
+    mPassAccesses.push_back({ buffer, access, true });
+}
+
+GLbitfield MemoryBarrierTracker::IssueBarrier()
+{
+    assert(mPassName && !mIsBarrierIssued);
+
+    // writes count too: the shader writes of a previous pass must land before they're overwritten
+    GLbitfield bits = 0;
+    for (const DeclaredAccess& access : mPassAccesses)
+    {
+        auto found = mUnsyncedBits.find(access.Buffer);
+        if (found != mUnsyncedBits.end())
+        {
+            bits |= found->second & kAccessBarrierBits[access.Access];
+        }
+    }
+
+    if (bits)
+    {
+        glMemoryBarrier(bits);
+
+        // the barrier isn't specific to the buffers of this pass
+        for (auto it = mUnsyncedBits.begin(); it != mUnsyncedBits.end(); )
+        {
+            it->second &= ~bits;
+            if (it->second == 0)
+            {
+                it = mUnsyncedBits.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    mLog.push_back({ mPassName, bits });
+    mIsBarrierIssued = true;
+    return bits;
+}
+
+void MemoryBarrierTracker::EndPass()
+{
+    assert(mPassName && mIsBarrierIssued);
+
+    GLbitfield allAccessBits = 0;
+    for (GLbitfield accessBits : kAccessBarrierBits)
+    {
+        allAccessBits |= accessBits;
+    }
+
+    for (const DeclaredAccess& access : mPassAccesses)
+    {
+        if (access.IsWrite && IsIncoherentWrite(access.Access))
+        {
+            mUnsyncedBits[access.Buffer] = allAccessBits;
+        }
+    }
+
+    mPassName = NULL;
+    mPassAccesses.clear();
+}
+
+void MemoryBarrierTracker::ClearLog()
+{
+    mLog.clear();
+}
+
+std::string GetMemoryBarrierBitsString(GLbitfield bits)
+{
+    static const struct { GLbitfield Bit; const char* Name; } kBitNames[] = {
+        { GL_SHADER_STORAGE_BARRIER_BIT, "SHADER_STORAGE" },
+        { GL_SHADER_IMAGE_ACCESS_BARRIER_BIT, "SHADER_IMAGE_ACCESS" },
+        { GL_TEXTURE_FETCH_BARRIER_BIT, "TEXTURE_FETCH" },
+        { GL_UNIFORM_BARRIER_BIT, "UNIFORM" },
+        { GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT, "VERTEX_ATTRIB_ARRAY" },
+        { GL_ELEMENT_ARRAY_BARRIER_BIT, "ELEMENT_ARRAY" },
+        { GL_TRANSFORM_FEEDBACK_BARRIER_BIT, "TRANSFORM_FEEDBACK" },
+        { GL_BUFFER_UPDATE_BARRIER_BIT, "BUFFER_UPDATE" },
+    };
+
+    std::string s;
+    for (const auto& bitName : kBitNames)
+    {
+        if (bits & bitName.Bit)
+        {
+            if (!s.empty())
+                s += " | ";
+            s += bitName.Name;
+        }
+    }
+    return s.empty() ? "none" : s;
+}
+
+} /* namespace buddha */
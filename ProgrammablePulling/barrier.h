@@ -0,0 +1,92 @@
+/*
+ * barrier.h
+ *
+ *  Tracking of the buffers written by shaders, to issue the minimal memory barriers between passes
+ */
+
+#ifndef BARRIER_H_
+#define BARRIER_H_
+
+#include <GL/glew.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace buddha {
+
+// How a pass accesses a buffer, each one is made visible by a different barrier bit
+enum BufferAccess
+{
+    BUFFER_ACCESS_SHADER_STORAGE,       // storage buffer, including atomics
+    BUFFER_ACCESS_SHADER_IMAGE,         // image load/store of a buffer texture
+    BUFFER_ACCESS_TEXTURE_FETCH,        // texelFetch of a buffer texture
+    BUFFER_ACCESS_UNIFORM,
+    BUFFER_ACCESS_VERTEX_ATTRIB,
+    BUFFER_ACCESS_ELEMENT_ARRAY,
+    BUFFER_ACCESS_TRANSFORM_FEEDBACK,
+    BUFFER_ACCESS_BUFFER_UPDATE,        // glClearBufferData, glCopyBufferSubData, glBufferSubData...
+    NUMBER_OF_BUFFER_ACCESSES
+};
+
+struct PassMemoryBarrier
+{
+    const char* PassName;
+    GLbitfield Bits;        // 0 if the pass didn't need a barrier
+};
+
+// Orders the passes of renderScene, in which each pass declares the buffers it reads and writes.
+// Only the writes of shaders (storage buffers and images) are incoherent and need a barrier, and only for the kinds of
+// accesses that later passes make to the buffers they wrote: the barrier before a pass only has the bits of its own accesses.
+// Writes by other GL commands (clears, copies, transform feedback) are ordered with the following commands by GL itself.
+//
+//  tracker.BeginPass("Pre-transform");
+//  tracker.Write(transformedVertexBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+//  tracker.IssueBarrier();
+//  glDispatchCompute(...);
+//  tracker.EndPass();
+class MemoryBarrierTracker
+{
+public:
+    MemoryBarrierTracker();
+
+    MemoryBarrierTracker(const MemoryBarrierTracker&) = delete;
+    MemoryBarrierTracker& operator=(const MemoryBarrierTracker&) = delete;
+
+    void BeginPass(const char* name);
+    void Read(GLuint buffer, BufferAccess access);
+    void Write(GLuint buffer, BufferAccess access);
+    // Issues the barrier needed by the accesses declared so far, if any. Call right before the GL commands of the pass.
+    GLbitfield IssueBarrier();
+    // Call after the GL commands of the pass: the next passes that access the buffers it wrote with shaders will wait for them.
+    void EndPass();
+
+    // Every pass and the barrier issued before it, since the last ClearLog
+    void ClearLog();
+    const std::vector<PassMemoryBarrier>& GetLog() const { return mLog; }
+
+private:
+    struct DeclaredAccess
+    {
+        GLuint Buffer;
+        BufferAccess Access;
+        bool IsWrite;
+    };
+
+    const char* mPassName;      // NULL outside of a pass
+    std::vector<DeclaredAccess> mPassAccesses;
+    bool mIsBarrierIssued;
+
+    // barrier bits that each buffer still needs before being accessed in the corresponding way.
+    // A deleted buffer is never removed: if its name is reused, the new buffer only gets an extra barrier.
+    std::unordered_map<GLuint, GLbitfield> mUnsyncedBits;
+
+    std::vector<PassMemoryBarrier> mLog;
+};
+
+// Names of the barrier bits, separated by " | ", or "none"
+std::string GetMemoryBarrierBitsString(GLbitfield bits);
+
+} /* namespace buddha */
+
+#endif /* BARRIER_H_ */
@@ -8,21 +8,173 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "wavefront.h"
+#include "readback.h"
+#include "upload.h"
+#include "profiler.h"
+#include "glstate.h"
+#include "barrier.h"
 
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
 
-// Keep this in sync with struct CachedVertex
-#define VERTEX_CACHE_VERTEX_SIZE_IN_DWORDS 12
+// <position index, normal index> stored after the vertex by the writer-only lock
+#define VERTEX_CACHE_KEY_SIZE_IN_DWORDS 2
 // Keep this in sync with CacheEntry
 #define VERTEX_CACHE_ENTRY_SIZE_IN_DWORDS 4
+// Keep this in sync with the counters at the start of CacheInstrumentationBuffer
+#define VERTEX_CACHE_INSTRUMENTATION_HEADER_SIZE_IN_DWORDS 4
+
+// Keep this in sync with local_size_x in pretransform.comp
+#define PRETRANSFORM_WORKGROUP_SIZE 64
+// Keep this in sync with TransformedVertex
+#define TRANSFORMED_VERTEX_SIZE_IN_DWORDS 12
+// Keep this in sync with TransformedPosition
+#define TRANSFORMED_POSITION_SIZE_IN_DWORDS 8
+#define TRANSFORMED_NORMAL_SIZE_IN_DWORDS 4
+
+// Keep this in sync with local_size_x in dedup_corners.comp
+#define DEDUP_WORKGROUP_SIZE 64
+// Keep this in sync with CornerSlot
+#define DEDUP_SLOT_SIZE_IN_DWORDS 4
+// Keep this in sync with BATCH_SIZE in batch_dedup.comp
+#define DEDUP_BATCH_SIZE 96
+
+// Number of frames whose timer queries can be in flight before renderScene has to wait for the oldest one
+#define TIMER_QUERY_RING_SIZE 4
+
+// Number of readbacks of each GPU counter that can be in flight
+#define READBACK_RING_SIZE 4
+
+// Number of renderScene calls whose transforms can be in flight, and transforms each of them can upload
+#define TRANSFORM_RING_SIZE 4
+#define MAX_TRANSFORMS_PER_SCENE 4096
+
+// Pipeline statistics in the order of the fields of PipelineStatistics
+static const GLenum kPipelineStatisticsTargets[] = {
+    GL_VERTICES_SUBMITTED_ARB,
+    GL_PRIMITIVES_SUBMITTED_ARB,
+    GL_VERTEX_SHADER_INVOCATIONS_ARB,
+    GL_CLIPPING_INPUT_PRIMITIVES_ARB,
+    GL_FRAGMENT_SHADER_INVOCATIONS_ARB,
+};
+#define NUMBER_OF_PIPELINE_STATISTICS (sizeof(kPipelineStatisticsTargets) / sizeof(*kPipelineStatisticsTargets))
+
+// GL_KHR_shader_subgroup is newer than the bundled GLEW
+#ifndef GL_SUBGROUP_SUPPORTED_STAGES_KHR
+#define GL_SUBGROUP_SUPPORTED_STAGES_KHR 0x9533
+#define GL_SUBGROUP_SUPPORTED_FEATURES_KHR 0x9534
+#define GL_SUBGROUP_FEATURE_BASIC_BIT_KHR 0x00000001
+#define GL_SUBGROUP_FEATURE_BALLOT_BIT_KHR 0x00000008
+#define GL_SUBGROUP_FEATURE_SHUFFLE_BIT_KHR 0x00000010
+#endif
 
 namespace buddha {
+
+// The encodings of CachedVertex in the VertexCache of the soft cache shader, in the order of SoftVertexCacheEncoding.
+// The shader gets their names and the size of the current one from its preamble, see SetSoftVertexCacheConfig.
+// Keep the sizes in sync with load_cached_vertex/store_cached_vertex.
+static const struct
+{
+    SoftVertexCacheEncoding Encoding;
+    const char* Name;
+    int SizeInDwords;
+} kVertexCacheEncodings[] = {
+    { SOFT_VERTEX_CACHE_ENCODING_FULL,                              "VERTEX_CACHE_ENCODING_FULL",                               12 },
+    { SOFT_VERTEX_CACHE_ENCODING_CLIP_POSITION,                     "VERTEX_CACHE_ENCODING_CLIP_POSITION",                      7 },
+    { SOFT_VERTEX_CACHE_ENCODING_CLIP_POSITION_OCTAHEDRAL_NORMAL,   "VERTEX_CACHE_ENCODING_CLIP_POSITION_OCTAHEDRAL_NORMAL",    5 },
+};
+static_assert(sizeof(kVertexCacheEncodings) / sizeof(*kVertexCacheEncodings) == NUMBER_OF_SOFT_VERTEX_CACHE_ENCODINGS, "every soft vertex cache encoding needs a size");
+
+// The result is passed to the shader as VERTEX_CACHE_VERTEX_SIZE_IN_DWORDS.
+static int GetVertexCacheVertexSizeInDwords(const SoftVertexCacheConfig& config)
+{
+    assert(config.VertexEncoding >= 0 && config.VertexEncoding < NUMBER_OF_SOFT_VERTEX_CACHE_ENCODINGS);
+    assert(kVertexCacheEncodings[config.VertexEncoding].Encoding == config.VertexEncoding);
+    int size = kVertexCacheEncodings[config.VertexEncoding].SizeInDwords;
+
+    // readers that don't lock validate entries against the key stored with the vertex.
+    if (config.LockStrategy == SOFT_VERTEX_CACHE_LOCK_WRITER_ONLY)
+    {
+        size += VERTEX_CACHE_KEY_SIZE_IN_DWORDS;
+    }
+
+    return size;
+}
+
+// Size of the largest encoding plus its key, used to size the vertex cache buffers so they fit any config
+static int GetVertexCacheMaxVertexSizeInDwords()
+{
+    int maxSize = 0;
+    for (const auto& encoding : kVertexCacheEncodings)
+    {
+        maxSize = std::max(maxSize, encoding.SizeInDwords);
+    }
+    return maxSize + VERTEX_CACHE_KEY_SIZE_IN_DWORDS;
+}
+
+// Keep this in sync with the lock implementations in the soft cache shader.
+static int GetVertexCacheLockSizeInDwords(const SoftVertexCacheConfig& config)
+{
+    // ticket locks need both a "next ticket" and a "now serving" counter
+    return config.LockStrategy == SOFT_VERTEX_CACHE_LOCK_TICKET ? 2 : 1;
+}
+
+static bool HasExtension(const char* name)
+{
+    GLint numExtensions;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+    for (GLint i = 0; i < numExtensions; i++)
+    {
+        if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the preamble that selects the extension used by shaders/puller_subgroup.vert, or NULL if none is supported.
+static const char* GetSubgroupPreamble(const char** pExtensionName)
+{
+    if (HasExtension("GL_KHR_shader_subgroup"))
+    {
+        GLint stages, features;
+        glGetIntegerv(GL_SUBGROUP_SUPPORTED_STAGES_KHR, &stages);
+        glGetIntegerv(GL_SUBGROUP_SUPPORTED_FEATURES_KHR, &features);
+
+        GLint requiredFeatures = GL_SUBGROUP_FEATURE_BASIC_BIT_KHR | GL_SUBGROUP_FEATURE_BALLOT_BIT_KHR | GL_SUBGROUP_FEATURE_SHUFFLE_BIT_KHR;
+        if ((stages & GL_VERTEX_SHADER_BIT) && (features & requiredFeatures) == requiredFeatures)
+        {
+            *pExtensionName = "GL_KHR_shader_subgroup";
+            return "#define SUBGROUP_KHR\n";
+        }
+    }
+
+    if (GLEW_ARB_shader_ballot && GLEW_ARB_gpu_shader_int64)
+    {
+        *pExtensionName = "GL_ARB_shader_ballot";
+        return "#define SUBGROUP_ARB\n";
+    }
+
+    if (GLEW_NV_shader_thread_group && GLEW_NV_shader_thread_shuffle)
+    {
+        *pExtensionName = "GL_NV_shader_thread_group";
+        return "#define SUBGROUP_NV\n";
+    }
+
+    *pExtensionName = NULL;
+    return NULL;
+}
     
 struct Transform {
 	glm::mat4 ModelViewMatrix;		// modelview matrix of the transformation
 	glm::mat4 ProjectionMatrix;		// projection matrix of the transformation
 	glm::mat4 MVPMatrix;			// modelview-projection matrix
+	glm::mat4 InverseProjectionMatrix;	// inverse of the projection matrix
 };
 
 struct Camera {
@@ -72,7 +224,7 @@ class BuddhaDemo : public IBuddhaDemo
     Camera camera;                          // camera data
 
     Transform transform;                    // transformation data
-    GLuint transformUB;                     // uniform buffer for the transformation
+    GPUUploadRing transformRing;            // uniform blocks of the transformation, written directly by the CPU
 
     struct VertexProg {
         GLuint prog;
@@ -93,7 +245,11 @@ class BuddhaDemo : public IBuddhaDemo
         GLuint uniquePositionBufferXYZW;
         GLuint uniqueNormalBufferXYZW;
 
+        int numIndices;                     // number of merged indices
         int numUniqueVerts;
+        int numVerts;                       // number of merged vertices
+        int numUniquePositions;
+        int numUniqueNormals;
 
         GLuint assemblyIndexBuffer;
         GLuint assemblyVertexArray;
@@ -137,6 +293,33 @@ class BuddhaDemo : public IBuddhaDemo
 
         GLuint vertexCacheBuffer;
 
+        // output of the pre-transform compute passes
+        GLuint transformedVertexBuffer;
+        GLuint transformedUniquePositionBuffer;
+        GLuint transformedUniqueNormalBuffer;
+
+        // OBJ-style corners merged into unique vertices on the GPU
+        GLuint dedupSlotBuffer;
+        GLuint dedupVertexCounterBuffer;
+        GLuint dedupPositionBuffer;
+        GLuint dedupNormalBuffer;
+        GLuint dedupIndexBuffer;
+        GLuint dedupVertexArray;
+        int numDedupSlots;
+        bool isDedupMeshStale;              // the deduplicated mesh needs to be (re)built
+        int numDedupVerts;                  // -1 until the vertex count of the first build is read back
+
+        // output of the batch-local deduplication, every batch has room for DEDUP_BATCH_SIZE vertices
+        GLuint batchVertexBuffer;
+        GLuint batchIndexBuffer;
+        int numDedupBatches;
+
+        // transformed vertices captured with transform feedback, and the matrices they were captured with
+        GLuint capturedVertexBuffer;
+        bool hasCapturedVertices;
+        glm::mat4 capturedModelViewMatrix;
+        glm::mat4 capturedMVPMatrix;
+
         DrawCommand drawCmd[NUMBER_OF_MODES_INCLUDING_DISABLED_ONES];   // draw command for the three vertex pulling modes
 
         void load(const char* path);
@@ -144,7 +327,52 @@ class BuddhaDemo : public IBuddhaDemo
 
     std::vector<PerModel> models;
 
-    GLuint timeElapsedQuery;                // query object for the time taken to render the scene
+    GLuint renderTargetFramebuffer;         // framebuffer renderScene draws to, 0 for the default framebuffer
+
+    struct RenderTarget {
+        GLuint framebuffer;
+        GLuint colorTexture;
+        GLuint depthTexture;
+        int width;
+        int height;
+    };
+
+    float renderScale;                      // resolution of the scene relative to the screen
+    RenderTarget scaledRenderTarget;        // the scene is rendered here instead when renderScale isn't 1
+    RenderTarget visibilityRenderTarget;    // triangle and instance IDs written by the first pass of the visibility buffer mode
+    GLuint visibilityResolvePipeline;       // full-screen pass of the visibility buffer mode
+
+    bool depthPrepassEnabled;
+    GLuint depthPrepassPipeline[NUMBER_OF_MODES_INCLUDING_DISABLED_ONES];  // position-only depth pass, for the modes where IsDepthPrepassMode is true
+
+    // timer queries of a frame. The results are only read once they are available, so the CPU doesn't wait for the GPU.
+    struct FrameTimerQueries {
+        GLuint timeElapsedQuery;                // query object for the time taken to render the scene
+        GLuint computeTimeElapsedQuery;         // query object for the time taken by the compute passes before the draw
+        GLuint depthPrepassTimeElapsedQuery;    // query object for the time taken by the depth prepass
+        GLuint pipelineStatisticsQueries[NUMBER_OF_PIPELINE_STATISTICS];   // one per kPipelineStatisticsTargets, around the draw
+        bool isPending;                         // the results haven't been read yet
+        bool hasComputePass;
+        bool hasDepthPrepass;
+        bool hasPipelineStatistics;
+        bool isOffscreen;                       // rendered by renderSceneToImage, the results are dropped
+        FrameTiming timing;                     // everything but the times is filled in when the frame is rendered
+    };
+
+    FrameTimerQueries frameTimerQueries[TIMER_QUERY_RING_SIZE];
+    bool pipelineStatisticsEnabled;
+    int nextFrameTimerQueries;              // oldest entry of the ring, and the next one to be used
+    uint64_t nextFrameNumber;
+    std::deque<FrameTiming> availableFrameTimings;
+
+    bool readFrameTimerQueries(FrameTimerQueries* pQueries, bool wait);
+
+    GLuint pretransformProg;                // compute shader program that transforms every merged vertex
+    GLuint pretransformPositionsProg;       // compute shader program that transforms every unique position
+    GLuint pretransformNormalsProg;         // compute shader program that transforms every unique normal
+    GLuint dedupCornersProg;                // compute shader program that merges OBJ-style corners into unique vertices
+    GLuint batchDedupProg;                  // compute shader program that deduplicates and transforms batches of indices
+    GLuint captureProg;                     // vertex shader program whose outputs are captured with transform feedback
 
     float cameraRotationFactor;             // camera rotation factor between [0,2*PI)
 
@@ -153,16 +381,40 @@ class BuddhaDemo : public IBuddhaDemo
     GLuint vertexCacheBucketLocksBuffer;
 
     GLuint vertexCacheMissCounterBuffer;
-    GLuint vertexCacheMissCounterReadbackBuffer;
+    GPUReadbackRing vertexCacheMissCounterReadback;     // tagged with the mesh ID
+
+    GLuint vertexCacheInstrumentationBuffer;
+    GPUReadbackRing vertexCacheInstrumentationReadback;
+    SoftVertexCacheInstrumentation lastVertexCacheInstrumentation;
+    bool hasVertexCacheInstrumentation;
 
     SoftVertexCacheConfig softVertexCacheConfig;
 
+    const char* subgroupExtensionName;      // extension used by the subgroup modes, NULL if unsupported
+
     int lastFrameNumVertexCacheMisses;
     int lastFrameMeshID;
 
+    GPUReadbackRing dedupVertexCounterReadback;         // tagged with the mesh ID
+
+    Profiler profiler;
+
+    // renderScene only sends the bindings that changed since the previous draw or dispatch
+    GLStateCache stateCache;
+
+    // barriers between the passes of renderScene, from the buffers each of them reads and writes
+    MemoryBarrierTracker barrierTracker;
+
     void loadShaders();
 
+    void readbackSoftVertexCacheInstrumentation(VertexPullingMode mode);
+
+    void resizeRenderTarget(RenderTarget* pTarget, int width, int height, GLenum colorFormat);
+
+    void renderSceneToImage(int meshID, const glm::mat4& modelMatrix, int screenWidth, int screenHeight, VertexPullingMode mode, std::vector<GLubyte>* pPixels);
+
     VertexProg loadShaderProgramFromFile(const char* filename, const char* preamble, GLenum shaderType);
+    GLuint loadTransformFeedbackProgramFromFile(const char* filename, const char* const* varyings, int numVaryings);
     GLuint createProgramPipeline(GLuint vertexShader, GLuint tessControlShader, GLuint tessEvaluationShader, GLuint geometryShader, GLuint fragmentShader);
     
     GLuint createProgramPipeline(const VertexProg& vertexShader, GLuint tessControlShader, GLuint tessEvaluationShader, GLuint geometryShader, GLuint fragmentShader)
@@ -175,13 +427,85 @@ public:
 
     int addMesh(const char* path) override;
 
-    void renderScene(int meshID, const glm::mat4& modelMatrix, int screenWidth, int screenHeight, float dtsec, VertexPullingMode mode, uint64_t* elapsedNanoseconds) override;
+    void renderScene(int meshID, const glm::mat4& modelMatrix, int screenWidth, int screenHeight, float dtsec, VertexPullingMode mode, uint64_t* pFrameNumber) override;
 
     std::string GetModeName(int mode) override
     {
         return vertexProg[mode].name;
     }
 
+    float GetRenderScale() const override
+    {
+        return renderScale;
+    }
+
+    void SetRenderScale(float scale) override
+    {
+        renderScale = scale;
+    }
+
+    void CompareModes(int meshID, const glm::mat4& modelMatrix, int screenWidth, int screenHeight, VertexPullingMode mode, VertexPullingMode referenceMode, int channelTolerance, ModeComparisonResult* pResult) override;
+
+    bool GetDepthPrepass() const override
+    {
+        return depthPrepassEnabled;
+    }
+
+    void SetDepthPrepass(bool enabled) override
+    {
+        depthPrepassEnabled = enabled;
+    }
+
+    bool PollFrameTiming(FrameTiming* pTiming) override;
+
+    bool IsPipelineStatisticsSupported() const override
+    {
+        return GLEW_ARB_pipeline_statistics_query != GL_FALSE;
+    }
+
+    bool GetPipelineStatistics() const override
+    {
+        return pipelineStatisticsEnabled;
+    }
+
+    void SetPipelineStatistics(bool enabled) override
+    {
+        pipelineStatisticsEnabled = enabled && IsPipelineStatisticsSupported();
+    }
+
+    void InvalidateDeduplicatedMesh(int meshID) override
+    {
+        models[meshID].isDedupMeshStale = true;
+    }
+
+    int GetNumDeduplicatedVertices(int meshID) const override
+    {
+        return models[meshID].numDedupVerts;
+    }
+
+    const char* GetSubgroupExtensionName() const override
+    {
+        return subgroupExtensionName;
+    }
+
+    Profiler* GetProfiler() override
+    {
+        return &profiler;
+    }
+
+    bool IsUsingMultiBind() const override
+    {
+        return stateCache.IsUsingMultiBind();
+    }
+
+    void GetLastSceneMemoryBarriers(std::vector<PassMemoryBarrier>* pBarriers) const override
+    {
+        *pBarriers = barrierTracker.GetLog();
+    }
+
+    void GetMeshMemoryFootprint(int meshID, std::vector<BufferFootprint>* pBuffers) const override;
+    ModeMemoryFootprint GetModeMemoryFootprint(int meshID, int mode) const override;
+
     SoftVertexCacheConfig GetSoftVertexCacheConfig() const override;
 
     void SetSoftVertexCacheConfig(const SoftVertexCacheConfig& config) override;
@@ -194,6 +518,15 @@ public:
             *pTotalNumVerts = models[lastFrameMeshID].numUniqueVerts;
     }
 
+    bool GetSoftVertexCacheInstrumentation(SoftVertexCacheInstrumentation* pInstrumentation) const override
+    {
+        if (!hasVertexCacheInstrumentation)
+            return false;
+        if (pInstrumentation)
+            *pInstrumentation = lastVertexCacheInstrumentation;
+        return true;
+    }
+
     void* operator new(size_t sz)
     {
         void* m = malloc(sz);
@@ -243,7 +576,11 @@ void BuddhaDemo::PerModel::load(const char* path)
         glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 
+    numIndices = int(buddhaObj.Indices.size());
     numUniqueVerts = int(buddhaObj.PositionIndices.size());
+    numVerts = int(buddhaObj.Positions.size());
+    numUniquePositions = int(buddhaObj.UniquePositions.size());
+    numUniqueNormals = int(buddhaObj.UniqueNormals.size());
 
     // unique position buffer
     {
@@ -569,6 +906,18 @@ void BuddhaDemo::PerModel::load(const char* path)
     drawCmd[PULLER_OBJ_SOFTCACHE_MODE].drawType = DRAWCMD_DRAWARRAYS;
     drawCmd[PULLER_OBJ_SOFTCACHE_MODE].drawArrays.count = (GLuint)buddhaObj.PositionIndices.size();
 
+    drawCmd[PULLER_SSBO_SOFTCACHE_MODE].vertexArray = nullVertexArray;
+    drawCmd[PULLER_SSBO_SOFTCACHE_MODE].drawType = DRAWCMD_DRAWARRAYS;
+    drawCmd[PULLER_SSBO_SOFTCACHE_MODE].drawArrays.count = (GLuint)buddhaObj.Indices.size();
+
+    drawCmd[PULLER_SSBO_SUBGROUP_MODE] = drawCmd[PULLER_SSBO_AOS_1FETCH_MODE];
+    drawCmd[PULLER_OBJ_SUBGROUP_MODE] = drawCmd[PULLER_OBJ_MODE];
+
+    drawCmd[PULLER_PRETRANSFORMED_MODE] = drawCmd[PULLER_SSBO_AOS_1FETCH_MODE];
+    drawCmd[PULLER_OBJ_PRETRANSFORMED_MODE] = drawCmd[PULLER_OBJ_MODE];
+
+    drawCmd[PULLER_BATCH_DEDUP_MODE] = drawCmd[PULLER_SSBO_AOS_1FETCH_MODE];
+
     drawCmd[GS_ASSEMBLER_MODE].vertexArray = assemblyVertexArray;
     drawCmd[GS_ASSEMBLER_MODE].drawType = DRAWCMD_DRAWELEMENTS;
     drawCmd[GS_ASSEMBLER_MODE].primType = GL_TRIANGLES_ADJACENCY; // hack to get patches of 6 vertices
@@ -580,6 +929,18 @@ void BuddhaDemo::PerModel::load(const char* path)
     drawCmd[TS_ASSEMBLER_MODE].patchVertices = 6;
     drawCmd[TS_ASSEMBLER_MODE].drawElements.count = (GLuint)buddhaObj.PositionIndices.size() * 2;
 
+    drawCmd[GS_PULLER_MODE].vertexArray = nullVertexArray;
+    drawCmd[GS_PULLER_MODE].drawType = DRAWCMD_DRAWARRAYS;
+    drawCmd[GS_PULLER_MODE].primType = GL_POINTS;
+    drawCmd[GS_PULLER_MODE].drawArrays.count = (GLuint)buddhaObj.PositionIndices.size() / 3;
+
+    drawCmd[VISIBILITY_BUFFER_MODE] = drawCmd[PULLER_OBJ_MODE];
+
+    drawCmd[PULLER_CAPTURED_MODE] = drawCmd[PULLER_SSBO_AOS_1FETCH_MODE];
+
+    drawCmd[PULLER_DERIVATIVE_NORMAL_MODE] = drawCmd[PULLER_SSBO_AOS_1FETCH_MODE];
+    drawCmd[GS_PULLER_FACE_NORMAL_MODE] = drawCmd[GS_PULLER_MODE];
+
     // create auxiliary texture buffers
     glGenTextures(1, &indexTexBufferR32I);
     glBindTexture(GL_TEXTURE_BUFFER, indexTexBufferR32I);
@@ -653,8 +1014,94 @@ void BuddhaDemo::PerModel::load(const char* path)
 
     glGenBuffers(1, &vertexCacheBuffer);
     glBindBuffer(GL_ARRAY_BUFFER, vertexCacheBuffer);
-    glBufferStorage(GL_ARRAY_BUFFER, VERTEX_CACHE_VERTEX_SIZE_IN_DWORDS * sizeof(uint32_t) * buddhaObj.PositionIndices.size(), NULL, 0);
+    glBufferStorage(GL_ARRAY_BUFFER, GetVertexCacheMaxVertexSizeInDwords() * sizeof(uint32_t) * buddhaObj.PositionIndices.size(), NULL, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &transformedVertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, transformedVertexBuffer);
+    glBufferStorage(GL_ARRAY_BUFFER, TRANSFORMED_VERTEX_SIZE_IN_DWORDS * sizeof(uint32_t) * buddhaObj.Positions.size(), NULL, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &transformedUniquePositionBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, transformedUniquePositionBuffer);
+    glBufferStorage(GL_ARRAY_BUFFER, TRANSFORMED_POSITION_SIZE_IN_DWORDS * sizeof(uint32_t) * buddhaObj.UniquePositions.size(), NULL, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &transformedUniqueNormalBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, transformedUniqueNormalBuffer);
+    glBufferStorage(GL_ARRAY_BUFFER, TRANSFORMED_NORMAL_SIZE_IN_DWORDS * sizeof(uint32_t) * buddhaObj.UniqueNormals.size(), NULL, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // buffers for merging the corners on the GPU. In the worst case every corner is unique.
+    {
+        size_t numCorners = buddhaObj.PositionIndices.size();
+
+        // keep the hash table at most half full so the probe sequences stay short
+        numDedupSlots = 1;
+        while ((size_t)numDedupSlots < numCorners * 2)
+        {
+            numDedupSlots *= 2;
+        }
+        isDedupMeshStale = true;
+        numDedupVerts = -1;
+
+        glGenBuffers(1, &dedupSlotBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, dedupSlotBuffer);
+        glBufferStorage(GL_ARRAY_BUFFER, DEDUP_SLOT_SIZE_IN_DWORDS * sizeof(uint32_t) * numDedupSlots, NULL, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glGenBuffers(1, &dedupVertexCounterBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, dedupVertexCounterBuffer);
+        glBufferStorage(GL_ARRAY_BUFFER, sizeof(GLuint), NULL, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glGenBuffers(1, &dedupPositionBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, dedupPositionBuffer);
+        glBufferStorage(GL_ARRAY_BUFFER, numCorners * sizeof(glm::vec4), NULL, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glGenBuffers(1, &dedupNormalBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, dedupNormalBuffer);
+        glBufferStorage(GL_ARRAY_BUFFER, numCorners * sizeof(glm::vec4), NULL, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glGenBuffers(1, &dedupIndexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, dedupIndexBuffer);
+        glBufferStorage(GL_ARRAY_BUFFER, numCorners * sizeof(GLuint), NULL, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glGenVertexArrays(1, &dedupVertexArray);
+        glBindVertexArray(dedupVertexArray);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, dedupIndexBuffer);
+        glBindVertexArray(0);
+
+        // set here rather than with the other draw commands, since the vertex array doesn't exist before
+        drawCmd[FETCHER_DEDUPLICATED_MODE].vertexArray = dedupVertexArray;
+        drawCmd[FETCHER_DEDUPLICATED_MODE].drawType = DRAWCMD_DRAWELEMENTS;
+        drawCmd[FETCHER_DEDUPLICATED_MODE].drawElements.count = (GLuint)numCorners;
+    }
+
+    // buffers for the batch-local deduplication
+    {
+        numDedupBatches = int((buddhaObj.Indices.size() + DEDUP_BATCH_SIZE - 1) / DEDUP_BATCH_SIZE);
+
+        glGenBuffers(1, &batchVertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, batchVertexBuffer);
+        glBufferStorage(GL_ARRAY_BUFFER, TRANSFORMED_VERTEX_SIZE_IN_DWORDS * sizeof(uint32_t) * DEDUP_BATCH_SIZE * numDedupBatches, NULL, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glGenBuffers(1, &batchIndexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, batchIndexBuffer);
+        glBufferStorage(GL_ARRAY_BUFFER, buddhaObj.Indices.size() * sizeof(GLuint), NULL, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // same layout as the output of the pre-transform compute pass
+    glGenBuffers(1, &capturedVertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, capturedVertexBuffer);
+    glBufferStorage(GL_ARRAY_BUFFER, TRANSFORMED_VERTEX_SIZE_IN_DWORDS * sizeof(uint32_t) * buddhaObj.Positions.size(), NULL, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    hasCapturedVertices = false;
 }
 
 BuddhaDemo::BuddhaDemo()
@@ -664,13 +1111,46 @@ BuddhaDemo::BuddhaDemo()
     // initialize camera data
     cameraRotationFactor = 0.f;
 
-    // create uniform buffer
-    glGenBuffers(1, &transformUB);
-    glBindBuffer(GL_UNIFORM_BUFFER, transformUB);
-    glBufferStorage(GL_UNIFORM_BUFFER, sizeof(transform), NULL, GL_DYNAMIC_STORAGE_BIT);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    // the scene goes to the default framebuffer unless renderSceneToImage redirects it
+    renderTargetFramebuffer = 0;
+
+    // created by the first frame that needs them
+    scaledRenderTarget = {};
+    visibilityRenderTarget = {};
+
+    renderScale = 1.0f;
+
+    depthPrepassEnabled = false;
+
+    // off until the GUI turns it on, the query results are only read when it's enabled
+    pipelineStatisticsEnabled = false;
 
-    glGenQueries(1, &timeElapsedQuery);
+    // create the uniform buffer ring. Each block is bound with glBindBufferRange, so they must be aligned like its offset.
+    GLint uniformBufferOffsetAlignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformBufferOffsetAlignment);
+    GLsizeiptr alignedTransformSize = (sizeof(transform) + uniformBufferOffsetAlignment - 1) / uniformBufferOffsetAlignment * uniformBufferOffsetAlignment;
+    transformRing.Init(alignedTransformSize * MAX_TRANSFORMS_PER_SCENE, TRANSFORM_RING_SIZE, uniformBufferOffsetAlignment);
+
+    // the ring starts empty. make_shared doesn't use the zeroing operator new, so every member that is read before being written must be set here.
+    nextFrameTimerQueries = 0;
+    nextFrameNumber = 0;
+    for (FrameTimerQueries& queries : frameTimerQueries)
+    {
+        queries.isPending = false;
+        queries.hasComputePass = false;
+        queries.hasDepthPrepass = false;
+        queries.hasPipelineStatistics = false;
+        queries.isOffscreen = false;
+        queries.timing = FrameTiming();
+        glGenQueries(1, &queries.timeElapsedQuery);
+        glGenQueries(1, &queries.computeTimeElapsedQuery);
+        glGenQueries(1, &queries.depthPrepassTimeElapsedQuery);
+        glGenQueries(NUMBER_OF_PIPELINE_STATISTICS, queries.pipelineStatisticsQueries);
+    }
+
+    profiler.Init(TIMER_QUERY_RING_SIZE);
+
+    stateCache.Init();
 
     loadShaders();
 
@@ -684,10 +1164,8 @@ BuddhaDemo::BuddhaDemo()
     glBufferStorage(GL_ARRAY_BUFFER, sizeof(GLuint), NULL, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    glGenBuffers(1, &vertexCacheMissCounterReadbackBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexCacheMissCounterReadbackBuffer);
-    glBufferStorage(GL_ARRAY_BUFFER, sizeof(GLuint), NULL, GL_CLIENT_STORAGE_BIT | GL_MAP_READ_BIT);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    vertexCacheMissCounterReadback.Init(sizeof(GLuint), READBACK_RING_SIZE);
+    dedupVertexCounterReadback.Init(sizeof(GLuint), READBACK_RING_SIZE);
 
     SoftVertexCacheConfig cacheConfig;
     cacheConfig.NumCacheBucketBits = 20;
@@ -696,32 +1174,46 @@ BuddhaDemo::BuddhaDemo()
     cacheConfig.NumCacheEntriesPerBucket = 2;
     cacheConfig.MaxSimultaneousReaders = 1000000; // this MUST be greater than the maximum concurrency of the GPU.
     cacheConfig.EnableCacheMissCounter = false;
+    cacheConfig.VertexEncoding = SOFT_VERTEX_CACHE_ENCODING_FULL;
+    cacheConfig.LockStrategy = SOFT_VERTEX_CACHE_LOCK_READERS_WRITER;
+    cacheConfig.EnableCacheInstrumentation = false;
     SetSoftVertexCacheConfig(cacheConfig);
 }
 
 int BuddhaDemo::addMesh(const char* path)
 {
-    PerModel model;
+    // value-initialized, so the names that load doesn't generate are 0 rather than garbage
+    PerModel model = PerModel();
     model.load(path);
     models.push_back(model);
     return (int)models.size() - 1;
 }
 
-BuddhaDemo::VertexProg BuddhaDemo::loadShaderProgramFromFile(const char* filename, const char* preamble, GLenum shaderType)
+static bool readTextFile(const char* filename, std::string* pText)
 {
     std::ifstream file(filename);
     if (!file) {
         std::cerr << "Unable to open file: " << filename << std::endl;
-        return {};
+        return false;
     }
 
     // weird C++ magic to read the file in one go
-    std::string source(
+    pText->assign(
         std::istreambuf_iterator<char>{file},
         std::istreambuf_iterator<char>{});
 
     if (file.bad()) {
         std::cerr << "Error reading the file: " << filename << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+BuddhaDemo::VertexProg BuddhaDemo::loadShaderProgramFromFile(const char* filename, const char* preamble, GLenum shaderType)
+{
+    std::string source;
+    if (!readTextFile(filename, &source)) {
         return {};
     }
 
@@ -747,14 +1239,53 @@ BuddhaDemo::VertexProg BuddhaDemo::loadShaderProgramFromFile(const char* filenam
 
 }
 
+// same as above, but the program is linked with the given outputs captured by transform feedback.
+// glCreateShaderProgramv can't be used since the varyings have to be set before linking.
+GLuint BuddhaDemo::loadTransformFeedbackProgramFromFile(const char* filename, const char* const* varyings, int numVaryings)
+{
+    std::string source;
+    if (!readTextFile(filename, &source)) {
+        return 0;
+    }
+
+    const GLchar* sources[] = {
+        "#version 430 core\n",
+        source.c_str()
+    };
+
+    GLuint shader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(shader, sizeof(sources) / sizeof(*sources), sources, NULL);
+    glCompileShader(shader);
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glTransformFeedbackVaryings(program, numVaryings, varyings, GL_INTERLEAVED_ATTRIBS);
+    glLinkProgram(program);
+    glDetachShader(program, shader);
+    glDeleteShader(shader);
+
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        std::cerr << "Failed to compile/link shader program: " << filename << std::endl;
+        GLchar log[10000];
+        glGetProgramInfoLog(program, 10000, NULL, log);
+        std::cerr << log << std::endl;
+        exit(1);
+    }
+
+    return program;
+
+}
+
 GLuint BuddhaDemo::createProgramPipeline(GLuint vertexShader, GLuint tessControlShader, GLuint tessEvaluationShader, GLuint geometryShader, GLuint fragmentShader) {
 
     GLuint pipeline;
     glGenProgramPipelines(1, &pipeline);
 
     if (vertexShader != 0) glUseProgramStages(pipeline, GL_VERTEX_SHADER_BIT, vertexShader);
-    if (tessControlShader != 0) glUseProgramStages(pipeline, GL_TESS_CONTROL_SHADER, tessControlShader);
-    if (tessEvaluationShader != 0) glUseProgramStages(pipeline, GL_TESS_EVALUATION_SHADER, tessEvaluationShader);
+    if (tessControlShader != 0) glUseProgramStages(pipeline, GL_TESS_CONTROL_SHADER_BIT, tessControlShader);
+    if (tessEvaluationShader != 0) glUseProgramStages(pipeline, GL_TESS_EVALUATION_SHADER_BIT, tessEvaluationShader);
     if (geometryShader != 0) glUseProgramStages(pipeline, GL_GEOMETRY_SHADER_BIT, geometryShader);
     if (fragmentShader != 0) glUseProgramStages(pipeline, GL_FRAGMENT_SHADER_BIT, fragmentShader);
 
@@ -777,8 +1308,12 @@ void BuddhaDemo::loadShaders()
 {
     std::cout << "> Loading shaders..." << std::endl;
 
+    // lighting shared by the fragment shaders that output the final color
+    std::string lightingPreamble;
+    readTextFile("shaders/lighting.glsl", &lightingPreamble);
+
     // load common fragment shader
-    fragmentProg = loadShaderProgramFromFile("shaders/common.frag", 0, GL_FRAGMENT_SHADER).prog;
+    fragmentProg = loadShaderProgramFromFile("shaders/common.frag", lightingPreamble.c_str(), GL_FRAGMENT_SHADER).prog;
 
     vertexProg[FIXED_FUNCTION_AOS_MODE] = loadShaderProgramFromFile("shaders/fixed_aos.vert", 0, GL_VERTEX_SHADER);
     progPipeline[FIXED_FUNCTION_AOS_MODE] = createProgramPipeline(vertexProg[FIXED_FUNCTION_AOS_MODE], 0, 0, 0, fragmentProg);
@@ -855,6 +1390,45 @@ void BuddhaDemo::loadShaders()
     vertexProg[PULLER_OBJ_MODE] = loadShaderProgramFromFile("shaders/puller_obj.vert", 0, GL_VERTEX_SHADER);
     progPipeline[PULLER_OBJ_MODE] = createProgramPipeline(vertexProg[PULLER_OBJ_MODE], 0, 0, 0, fragmentProg);
 
+    const char* subgroupPreamble = GetSubgroupPreamble(&subgroupExtensionName);
+    if (subgroupPreamble)
+    {
+        std::string objPreamble = std::string(subgroupPreamble) + "#define SUBGROUP_OBJ\n";
+        vertexProg[PULLER_SSBO_SUBGROUP_MODE] = loadShaderProgramFromFile("shaders/puller_subgroup.vert", subgroupPreamble, GL_VERTEX_SHADER);
+        vertexProg[PULLER_OBJ_SUBGROUP_MODE] = loadShaderProgramFromFile("shaders/puller_subgroup.vert", objPreamble.c_str(), GL_VERTEX_SHADER);
+    }
+    else
+    {
+        std::cout << "> Subgroup operations not supported, subgroup modes use the plain puller shaders" << std::endl;
+        vertexProg[PULLER_SSBO_SUBGROUP_MODE] = loadShaderProgramFromFile("shaders/puller_ssbo_aos_1fetch.vert", 0, GL_VERTEX_SHADER);
+        vertexProg[PULLER_OBJ_SUBGROUP_MODE] = loadShaderProgramFromFile("shaders/puller_obj.vert", 0, GL_VERTEX_SHADER);
+    }
+    progPipeline[PULLER_SSBO_SUBGROUP_MODE] = createProgramPipeline(vertexProg[PULLER_SSBO_SUBGROUP_MODE], 0, 0, 0, fragmentProg);
+    progPipeline[PULLER_OBJ_SUBGROUP_MODE] = createProgramPipeline(vertexProg[PULLER_OBJ_SUBGROUP_MODE], 0, 0, 0, fragmentProg);
+
+    pretransformProg = loadShaderProgramFromFile("shaders/pretransform.comp", 0, GL_COMPUTE_SHADER).prog;
+    vertexProg[PULLER_PRETRANSFORMED_MODE] = loadShaderProgramFromFile("shaders/pretransformed.vert", 0, GL_VERTEX_SHADER);
+    progPipeline[PULLER_PRETRANSFORMED_MODE] = createProgramPipeline(vertexProg[PULLER_PRETRANSFORMED_MODE], 0, 0, 0, fragmentProg);
+
+    // the captured vertices have the same layout as the pre-transformed ones, so they are drawn the same way
+    const char* const kCapturedVaryings[] = { "outViewPosition", "outViewNormal", "outClipPosition" };
+    captureProg = loadTransformFeedbackProgramFromFile("shaders/capture.vert", kCapturedVaryings, sizeof(kCapturedVaryings) / sizeof(*kCapturedVaryings));
+    vertexProg[PULLER_CAPTURED_MODE] = loadShaderProgramFromFile("shaders/pretransformed.vert", 0, GL_VERTEX_SHADER);
+    progPipeline[PULLER_CAPTURED_MODE] = createProgramPipeline(vertexProg[PULLER_CAPTURED_MODE], 0, 0, 0, fragmentProg);
+
+    pretransformPositionsProg = loadShaderProgramFromFile("shaders/pretransform_positions.comp", 0, GL_COMPUTE_SHADER).prog;
+    pretransformNormalsProg = loadShaderProgramFromFile("shaders/pretransform_normals.comp", 0, GL_COMPUTE_SHADER).prog;
+    vertexProg[PULLER_OBJ_PRETRANSFORMED_MODE] = loadShaderProgramFromFile("shaders/pretransformed_obj.vert", 0, GL_VERTEX_SHADER);
+    progPipeline[PULLER_OBJ_PRETRANSFORMED_MODE] = createProgramPipeline(vertexProg[PULLER_OBJ_PRETRANSFORMED_MODE], 0, 0, 0, fragmentProg);
+
+    dedupCornersProg = loadShaderProgramFromFile("shaders/dedup_corners.comp", 0, GL_COMPUTE_SHADER).prog;
+    vertexProg[FETCHER_DEDUPLICATED_MODE] = loadShaderProgramFromFile("shaders/fetcher_ssbo_aos_1fetch.vert", 0, GL_VERTEX_SHADER);
+    progPipeline[FETCHER_DEDUPLICATED_MODE] = createProgramPipeline(vertexProg[FETCHER_DEDUPLICATED_MODE], 0, 0, 0, fragmentProg);
+
+    batchDedupProg = loadShaderProgramFromFile("shaders/batch_dedup.comp", 0, GL_COMPUTE_SHADER).prog;
+    vertexProg[PULLER_BATCH_DEDUP_MODE] = loadShaderProgramFromFile("shaders/pretransformed.vert", 0, GL_VERTEX_SHADER);
+    progPipeline[PULLER_BATCH_DEDUP_MODE] = createProgramPipeline(vertexProg[PULLER_BATCH_DEDUP_MODE], 0, 0, 0, fragmentProg);
+
     vertexProg[GS_ASSEMBLER_MODE] = loadShaderProgramFromFile("shaders/assembler.vert", 0, GL_VERTEX_SHADER);
     GLuint assemblyGeom = loadShaderProgramFromFile("shaders/gs_assembler.geom", 0, GL_GEOMETRY_SHADER).prog;
     progPipeline[GS_ASSEMBLER_MODE] = createProgramPipeline(vertexProg[GS_ASSEMBLER_MODE], 0, 0, assemblyGeom, fragmentProg);
@@ -863,6 +1437,44 @@ void BuddhaDemo::loadShaders()
     GLuint assemblyTesc = loadShaderProgramFromFile("shaders/ts_assembler.tesc", 0, GL_TESS_CONTROL_SHADER).prog;
     GLuint assemblyTese = loadShaderProgramFromFile("shaders/ts_assembler.tese", 0, GL_TESS_EVALUATION_SHADER).prog;
     progPipeline[TS_ASSEMBLER_MODE] = createProgramPipeline(vertexProg[TS_ASSEMBLER_MODE], assemblyTesc, assemblyTese, 0, fragmentProg);
+
+    vertexProg[GS_PULLER_MODE] = loadShaderProgramFromFile("shaders/gs_puller.vert", 0, GL_VERTEX_SHADER);
+    GLuint pullerGeom = loadShaderProgramFromFile("shaders/gs_puller.geom", 0, GL_GEOMETRY_SHADER).prog;
+    progPipeline[GS_PULLER_MODE] = createProgramPipeline(vertexProg[GS_PULLER_MODE], 0, 0, pullerGeom, fragmentProg);
+
+    // depth prepasses, the define selects the same inputs as the mode's main pass
+    struct DepthPrepassDefine { VertexPullingMode Mode; const char* Preamble; };
+    const DepthPrepassDefine kDepthPrepassDefines[] = {
+        { FIXED_FUNCTION_AOS_XYZW_MODE,    "#define PREPASS_FIXED_AOS\n" },
+        { FIXED_FUNCTION_SOA_MODE,         "#define PREPASS_FIXED_SOA\n" },
+        { FIXED_FUNCTION_INTERLEAVED_MODE, "#define PREPASS_FIXED_AOS\n" },
+        { PULLER_SSBO_AOS_1FETCH_MODE,     "#define PREPASS_SSBO_AOS\n" },
+        { PULLER_SSBO_SOA_MODE,            "#define PREPASS_SSBO_SOA\n" },
+        { PULLER_OBJ_MODE,                 "#define PREPASS_OBJ\n" },
+    };
+    for (const DepthPrepassDefine& define : kDepthPrepassDefines)
+    {
+        assert(IsDepthPrepassMode(define.Mode));
+        GLuint depthPrepassVert = loadShaderProgramFromFile("shaders/depth_prepass.vert", define.Preamble, GL_VERTEX_SHADER).prog;
+        depthPrepassPipeline[define.Mode] = createProgramPipeline(depthPrepassVert, 0, 0, 0, 0);
+    }
+
+    // normal-free modes
+    vertexProg[PULLER_DERIVATIVE_NORMAL_MODE] = loadShaderProgramFromFile("shaders/puller_ssbo_positions.vert", 0, GL_VERTEX_SHADER);
+    GLuint derivativeNormalFrag = loadShaderProgramFromFile("shaders/derivative_normal.frag", lightingPreamble.c_str(), GL_FRAGMENT_SHADER).prog;
+    progPipeline[PULLER_DERIVATIVE_NORMAL_MODE] = createProgramPipeline(vertexProg[PULLER_DERIVATIVE_NORMAL_MODE], 0, 0, 0, derivativeNormalFrag);
+
+    vertexProg[GS_PULLER_FACE_NORMAL_MODE] = loadShaderProgramFromFile("shaders/gs_puller.vert", 0, GL_VERTEX_SHADER);
+    GLuint pullerFaceNormalGeom = loadShaderProgramFromFile("shaders/gs_puller.geom", "#define FACE_NORMALS\n", GL_GEOMETRY_SHADER).prog;
+    progPipeline[GS_PULLER_FACE_NORMAL_MODE] = createProgramPipeline(vertexProg[GS_PULLER_FACE_NORMAL_MODE], 0, 0, pullerFaceNormalGeom, fragmentProg);
+
+    vertexProg[VISIBILITY_BUFFER_MODE] = loadShaderProgramFromFile("shaders/visibility.vert", 0, GL_VERTEX_SHADER);
+    GLuint visibilityFrag = loadShaderProgramFromFile("shaders/visibility.frag", 0, GL_FRAGMENT_SHADER).prog;
+    progPipeline[VISIBILITY_BUFFER_MODE] = createProgramPipeline(vertexProg[VISIBILITY_BUFFER_MODE], 0, 0, 0, visibilityFrag);
+
+    GLuint fullscreenVert = loadShaderProgramFromFile("shaders/fullscreen.vert", 0, GL_VERTEX_SHADER).prog;
+    GLuint visibilityResolveFrag = loadShaderProgramFromFile("shaders/visibility_resolve.frag", lightingPreamble.c_str(), GL_FRAGMENT_SHADER).prog;
+    visibilityResolvePipeline = createProgramPipeline(fullscreenVert, 0, 0, 0, visibilityResolveFrag);
 }
 
 SoftVertexCacheConfig BuddhaDemo::GetSoftVertexCacheConfig() const
@@ -874,24 +1486,51 @@ void BuddhaDemo::SetSoftVertexCacheConfig(const SoftVertexCacheConfig& config)
 {
     softVertexCacheConfig = config;
 
+    // try-once is the readers-writer lock with a single attempt.
+    bool tryOnce = config.LockStrategy == SOFT_VERTEX_CACHE_LOCK_TRY_ONCE;
+    int numReadCacheLockAttempts = tryOnce ? 1 : config.NumReadCacheLockAttempts;
+    int numWriteCacheLockAttempts = tryOnce ? 1 : config.NumWriteCacheLockAttempts;
+
     std::string softcache_preamble =
         "#define NUM_CACHE_BUCKETS " + std::to_string(1 << (config.NumCacheBucketBits - 1)) + "\n" +
-        "#define NUM_READ_CACHE_LOCK_ATTEMPTS " + std::to_string(config.NumReadCacheLockAttempts) + "\n" +
-        "#define NUM_WRITE_CACHE_LOCK_ATTEMPTS " + std::to_string(config.NumWriteCacheLockAttempts) + "\n" +
+        "#define NUM_READ_CACHE_LOCK_ATTEMPTS " + std::to_string(numReadCacheLockAttempts) + "\n" +
+        "#define NUM_WRITE_CACHE_LOCK_ATTEMPTS " + std::to_string(numWriteCacheLockAttempts) + "\n" +
         "#define NUM_CACHE_ENTRIES_PER_BUCKET " + std::to_string(config.NumCacheEntriesPerBucket) + "\n" +
-        "#define MAX_SIMULTANEOUS_READERS " + std::to_string(config.MaxSimultaneousReaders) + "\n";
+        "#define MAX_SIMULTANEOUS_READERS " + std::to_string(config.MaxSimultaneousReaders) + "\n" +
+        "#define VERTEX_CACHE_ENCODING " + std::to_string(config.VertexEncoding) + "\n" +
+        "#define VERTEX_CACHE_VERTEX_SIZE_IN_DWORDS " + std::to_string(GetVertexCacheVertexSizeInDwords(config)) + "\n" +
+        "#define VERTEX_CACHE_KEY_SIZE_IN_DWORDS " + std::to_string(VERTEX_CACHE_KEY_SIZE_IN_DWORDS) + "\n" +
+        "#define CACHE_LOCK_STRATEGY " + std::to_string(config.LockStrategy) + "\n";
+
+    for (const auto& encoding : kVertexCacheEncodings)
+    {
+        softcache_preamble += std::string("#define ") + encoding.Name + " " + std::to_string(encoding.Encoding) + "\n";
+    }
 
     if (config.EnableCacheMissCounter)
     {
         softcache_preamble += "#define ENABLE_CACHE_MISS_COUNTER\n";
     }
 
+    if (config.EnableCacheInstrumentation)
+    {
+        softcache_preamble += "#define ENABLE_CACHE_INSTRUMENTATION\n";
+    }
+
     glDeleteProgram(vertexProg[PULLER_OBJ_SOFTCACHE_MODE].prog);
     vertexProg[PULLER_OBJ_SOFTCACHE_MODE] = loadShaderProgramFromFile("shaders/puller_obj_softcache.vert", softcache_preamble.c_str(), GL_VERTEX_SHADER);
     
     glDeleteProgramPipelines(1, &progPipeline[PULLER_OBJ_SOFTCACHE_MODE]);
     progPipeline[PULLER_OBJ_SOFTCACHE_MODE] = createProgramPipeline(vertexProg[PULLER_OBJ_SOFTCACHE_MODE], 0, 0, 0, fragmentProg);
 
+    std::string single_index_softcache_preamble = softcache_preamble + "#define SOFTCACHE_SINGLE_INDEX\n";
+
+    glDeleteProgram(vertexProg[PULLER_SSBO_SOFTCACHE_MODE].prog);
+    vertexProg[PULLER_SSBO_SOFTCACHE_MODE] = loadShaderProgramFromFile("shaders/puller_obj_softcache.vert", single_index_softcache_preamble.c_str(), GL_VERTEX_SHADER);
+
+    glDeleteProgramPipelines(1, &progPipeline[PULLER_SSBO_SOFTCACHE_MODE]);
+    progPipeline[PULLER_SSBO_SOFTCACHE_MODE] = createProgramPipeline(vertexProg[PULLER_SSBO_SOFTCACHE_MODE], 0, 0, 0, fragmentProg);
+
     GLsizei bucketSizeInBytes = VERTEX_CACHE_ENTRY_SIZE_IN_DWORDS * config.NumCacheEntriesPerBucket * sizeof(GLuint);
     GLsizei numBuckets = GLsizei(1 << (config.NumCacheBucketBits - 1));
 
@@ -904,12 +1543,524 @@ void BuddhaDemo::SetSoftVertexCacheConfig(const SoftVertexCacheConfig& config)
     glDeleteBuffers(1, &vertexCacheBucketLocksBuffer);
     glGenBuffers(1, &vertexCacheBucketLocksBuffer);
     glBindBuffer(GL_ARRAY_BUFFER, vertexCacheBucketLocksBuffer);
-    glBufferStorage(GL_ARRAY_BUFFER, sizeof(GLuint) * numBuckets, NULL, 0);
+    glBufferStorage(GL_ARRAY_BUFFER, GetVertexCacheLockSizeInDwords(config) * sizeof(GLuint) * numBuckets, NULL, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    hasVertexCacheInstrumentation = false;
+
+    GLsizei instrumentationSizeInBytes = (VERTEX_CACHE_INSTRUMENTATION_HEADER_SIZE_IN_DWORDS + config.NumCacheEntriesPerBucket + numBuckets) * sizeof(GLuint);
+
+    glDeleteBuffers(1, &vertexCacheInstrumentationBuffer);
+    glGenBuffers(1, &vertexCacheInstrumentationBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexCacheInstrumentationBuffer);
+    glBufferStorage(GL_ARRAY_BUFFER, instrumentationSizeInBytes, NULL, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // pending readbacks refer to the old layout, so they are dropped along with the old buffers
+    vertexCacheInstrumentationReadback.Init(instrumentationSizeInBytes, READBACK_RING_SIZE);
+
+    // the deleted pipelines and buffers may still be bound, and their names reused by the new ones
+    stateCache.Invalidate();
+}
+
+void BuddhaDemo::resizeRenderTarget(RenderTarget* pTarget, int width, int height, GLenum colorFormat)
+{
+    if (pTarget->framebuffer != 0 && pTarget->width == width && pTarget->height == height)
+    {
+        return;
+    }
+
+    glDeleteFramebuffers(1, &pTarget->framebuffer);
+    glDeleteTextures(1, &pTarget->colorTexture);
+    glDeleteTextures(1, &pTarget->depthTexture);
+
+    glGenTextures(1, &pTarget->colorTexture);
+    glBindTexture(GL_TEXTURE_2D, pTarget->colorTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, colorFormat, width, height);
+    // the default filters use mipmaps and are linear, which leaves an integer texture like the visibility buffer incomplete
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenTextures(1, &pTarget->depthTexture);
+    glBindTexture(GL_TEXTURE_2D, pTarget->depthTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &pTarget->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, pTarget->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pTarget->colorTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, pTarget->depthTexture, 0);
+    assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    pTarget->width = width;
+    pTarget->height = height;
+}
+
+void BuddhaDemo::renderSceneToImage(int meshID, const glm::mat4& modelMatrix, int screenWidth, int screenHeight, VertexPullingMode mode, std::vector<GLubyte>* pPixels)
+{
+    GLuint colorTexture;
+    glGenTextures(1, &colorTexture);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_SRGB8_ALPHA8, screenWidth, screenHeight);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLuint depthTexture;
+    glGenTextures(1, &depthTexture);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, screenWidth, screenHeight);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLuint framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // no animation, so both images are rendered from the same viewpoint
+    renderTargetFramebuffer = framebuffer;
+    renderScene(meshID, modelMatrix, screenWidth, screenHeight, 0.0f, mode, NULL);
+    renderTargetFramebuffer = 0;
+
+    pPixels->resize(screenWidth * screenHeight * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, screenWidth, screenHeight, GL_RGBA, GL_UNSIGNED_BYTE, pPixels->data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &colorTexture);
+    glDeleteTextures(1, &depthTexture);
 }
 
-void BuddhaDemo::renderScene(int meshID, const glm::mat4& modelMatrix, int screenWidth, int screenHeight, float dtsec, VertexPullingMode mode, uint64_t* elapsedNanoseconds)
+void BuddhaDemo::CompareModes(int meshID, const glm::mat4& modelMatrix, int screenWidth, int screenHeight, VertexPullingMode mode, VertexPullingMode referenceMode, int channelTolerance, ModeComparisonResult* pResult)
 {
+    std::vector<GLubyte> pixels;
+    std::vector<GLubyte> referencePixels;
+    renderSceneToImage(meshID, modelMatrix, screenWidth, screenHeight, mode, &pixels);
+    renderSceneToImage(meshID, modelMatrix, screenWidth, screenHeight, referenceMode, &referencePixels);
+
+    ModeComparisonResult result = {};
+    result.NumPixels = screenWidth * screenHeight;
+    for (int i = 0; i < result.NumPixels; i++)
+    {
+        const GLubyte* pPixel = &pixels[i * 4];
+        const GLubyte* pReferencePixel = &referencePixels[i * 4];
+
+        // the scene is cleared to transparent black and the mesh writes alpha
+        if (pPixel[3] != 0 || pReferencePixel[3] != 0)
+        {
+            result.NumCoveredPixels++;
+        }
+
+        int pixelDifference = 0;
+        for (int c = 0; c < 4; c++)
+        {
+            pixelDifference = std::max(pixelDifference, std::abs((int)pPixel[c] - (int)pReferencePixel[c]));
+        }
+
+        if (pixelDifference > channelTolerance)
+        {
+            result.NumDifferentPixels++;
+        }
+        result.MaxChannelDifference = std::max(result.MaxChannelDifference, pixelDifference);
+    }
+
+    *pResult = result;
+}
+
+// Keep the sizes in sync with PerModel::load
+void BuddhaDemo::GetMeshMemoryFootprint(int meshID, std::vector<BufferFootprint>* pBuffers) const
+{
+    const PerModel& model = models[meshID];
+
+    uint64_t numIndices = model.numIndices;
+    uint64_t numCorners = model.numUniqueVerts;
+    uint64_t numVerts = model.numVerts;
+    uint64_t numPositions = model.numUniquePositions;
+    uint64_t numNormals = model.numUniqueNormals;
+
+    auto addBuffer = [pBuffers](const char* name, uint64_t bytes)
+    {
+        BufferFootprint buffer;
+        buffer.Name = name;
+        buffer.Bytes = bytes;
+        pBuffers->push_back(buffer);
+    };
+
+    pBuffers->clear();
+    addBuffer("indexBuffer", numIndices * sizeof(GLuint));
+    addBuffer("positionIndexBuffer", numCorners * sizeof(GLuint));
+    addBuffer("normalIndexBuffer", numCorners * sizeof(GLuint));
+    addBuffer("uniquePositionBufferXYZW", numPositions * sizeof(glm::vec4));
+    addBuffer("uniqueNormalBufferXYZW", numNormals * sizeof(glm::vec4));
+    addBuffer("assemblyIndexBuffer", numCorners * 2 * sizeof(GLuint));
+    addBuffer("interleavedBuffer", numVerts * 2 * sizeof(glm::vec3));
+    addBuffer("positionBuffer", numVerts * sizeof(glm::vec3));
+    addBuffer("normalBuffer", numVerts * sizeof(glm::vec3));
+    addBuffer("positionBufferXYZW", numVerts * sizeof(glm::vec4));
+    addBuffer("normalBufferXYZW", numVerts * sizeof(glm::vec4));
+    addBuffer("positionX/Y/ZBuffer", numVerts * 3 * sizeof(float));
+    addBuffer("normalX/Y/ZBuffer", numVerts * 3 * sizeof(float));
+    addBuffer("vertexCacheBuffer", numCorners * GetVertexCacheMaxVertexSizeInDwords() * sizeof(uint32_t));
+    addBuffer("transformedVertexBuffer", numVerts * TRANSFORMED_VERTEX_SIZE_IN_DWORDS * sizeof(uint32_t));
+    addBuffer("transformedUniquePositionBuffer", numPositions * TRANSFORMED_POSITION_SIZE_IN_DWORDS * sizeof(uint32_t));
+    addBuffer("transformedUniqueNormalBuffer", numNormals * TRANSFORMED_NORMAL_SIZE_IN_DWORDS * sizeof(uint32_t));
+    addBuffer("dedupSlotBuffer", uint64_t(model.numDedupSlots) * DEDUP_SLOT_SIZE_IN_DWORDS * sizeof(uint32_t));
+    addBuffer("dedupPosition/NormalBuffer", numCorners * 2 * sizeof(glm::vec4));
+    addBuffer("dedupIndexBuffer", numCorners * sizeof(GLuint));
+    addBuffer("batchVertexBuffer", uint64_t(model.numDedupBatches) * DEDUP_BATCH_SIZE * TRANSFORMED_VERTEX_SIZE_IN_DWORDS * sizeof(uint32_t));
+    addBuffer("batchIndexBuffer", numIndices * sizeof(GLuint));
+    addBuffer("capturedVertexBuffer", numVerts * TRANSFORMED_VERTEX_SIZE_IN_DWORDS * sizeof(uint32_t));
+}
+
+// Keep this in sync with the buffers bound by renderScene and the layouts read by the shaders
+ModeMemoryFootprint BuddhaDemo::GetModeMemoryFootprint(int meshID, int mode) const
+{
+    const PerModel& model = models[meshID];
+
+    uint64_t numIndices = model.numIndices;
+    uint64_t numCorners = model.numUniqueVerts;
+    uint64_t numVerts = model.numVerts;
+    uint64_t numPositions = model.numUniquePositions;
+    uint64_t numNormals = model.numUniqueNormals;
+
+    const uint64_t kIndexSize = sizeof(GLuint);
+    const uint64_t kXYZSize = sizeof(glm::vec3);
+    const uint64_t kXYZWSize = sizeof(glm::vec4);
+    const uint64_t kComponentSize = sizeof(float);
+    const uint64_t kTransformedVertexSize = TRANSFORMED_VERTEX_SIZE_IN_DWORDS * sizeof(uint32_t);
+
+    ModeMemoryFootprint footprint = {};
+
+    // a buffer of numElements elements, numAccesses of which are read or written per frame
+    auto addBuffer = [&footprint](uint64_t elementSize, uint64_t numElements, uint64_t numAccesses)
+    {
+        footprint.ResidentBytes += elementSize * numElements;
+        footprint.BytesPerFrame += elementSize * numAccesses;
+    };
+
+    // more accesses to a buffer that was already added
+    auto addAccesses = [&footprint](uint64_t elementSize, uint64_t numAccesses)
+    {
+        footprint.BytesPerFrame += elementSize * numAccesses;
+    };
+
+    switch (mode)
+    {
+    case FIXED_FUNCTION_AOS_MODE:
+    case FETCHER_AOS_1RGBFETCH_MODE:
+    case FETCHER_AOS_3FETCH_MODE:
+    case FETCHER_IMAGE_AOS_3FETCH_MODE:
+    case FETCHER_SSBO_AOS_3FETCH_MODE:
+    case PULLER_AOS_1RGBFETCH_MODE:
+    case PULLER_AOS_3FETCH_MODE:
+    case PULLER_IMAGE_AOS_3FETCH_MODE:
+    case PULLER_SSBO_AOS_3FETCH_MODE:
+        addBuffer(kIndexSize, numIndices, numIndices);
+        addBuffer(kXYZSize, numVerts, numIndices);
+        addBuffer(kXYZSize, numVerts, numIndices);
+        break;
+    case FIXED_FUNCTION_AOS_XYZW_MODE:
+    case FETCHER_AOS_1RGBAFETCH_MODE:
+    case FETCHER_IMAGE_AOS_1FETCH_MODE:
+    case FETCHER_SSBO_AOS_1FETCH_MODE:
+    case PULLER_AOS_1RGBAFETCH_MODE:
+    case PULLER_IMAGE_AOS_1FETCH_MODE:
+    case PULLER_SSBO_AOS_1FETCH_MODE:
+    case PULLER_SSBO_SUBGROUP_MODE:
+        addBuffer(kIndexSize, numIndices, numIndices);
+        addBuffer(kXYZWSize, numVerts, numIndices);
+        addBuffer(kXYZWSize, numVerts, numIndices);
+        break;
+    case FIXED_FUNCTION_SOA_MODE:
+    case FETCHER_SOA_MODE:
+    case FETCHER_IMAGE_SOA_MODE:
+    case FETCHER_SSBO_SOA_MODE:
+    case PULLER_SOA_MODE:
+    case PULLER_IMAGE_SOA_MODE:
+    case PULLER_SSBO_SOA_MODE:
+        addBuffer(kIndexSize, numIndices, numIndices);
+        for (int i = 0; i < 6; i++)
+        {
+            addBuffer(kComponentSize, numVerts, numIndices);
+        }
+        break;
+    case FIXED_FUNCTION_INTERLEAVED_MODE:
+        addBuffer(kIndexSize, numIndices, numIndices);
+        addBuffer(2 * kXYZSize, numVerts, numIndices);
+        break;
+    case PULLER_OBJ_MODE:
+    case PULLER_OBJ_SUBGROUP_MODE:
+    case GS_PULLER_MODE:
+        addBuffer(kIndexSize, numCorners, numCorners);
+        addBuffer(kIndexSize, numCorners, numCorners);
+        addBuffer(kXYZWSize, numPositions, numCorners);
+        addBuffer(kXYZWSize, numNormals, numCorners);
+        break;
+    case GS_PULLER_FACE_NORMAL_MODE:
+        addBuffer(kIndexSize, numCorners, numCorners);
+        addBuffer(kXYZWSize, numPositions, numCorners);
+        break;
+    case VISIBILITY_BUFFER_MODE:
+        // the normals are only read by the full-screen pass, whose per-pixel reads aren't counted
+        addBuffer(kIndexSize, numCorners, numCorners);
+        addBuffer(kIndexSize, numCorners, 0);
+        addBuffer(kXYZWSize, numPositions, numCorners);
+        addBuffer(kXYZWSize, numNormals, 0);
+        break;
+    case GS_ASSEMBLER_MODE:
+    case TS_ASSEMBLER_MODE:
+        // one position or normal per assembly index
+        addBuffer(kIndexSize, numCorners * 2, numCorners * 2);
+        addBuffer(kXYZWSize, numPositions, numCorners);
+        addBuffer(kXYZWSize, numNormals, numCorners);
+        break;
+    case PULLER_OBJ_SOFTCACHE_MODE:
+    case PULLER_SSBO_SOFTCACHE_MODE:
+    {
+        // every corner looks up its bucket and reads or writes one cached vertex.
+        // only the misses fetch and transform the vertex, assumed to be one per merged vertex.
+        const SoftVertexCacheConfig& config = softVertexCacheConfig;
+        uint64_t numBuckets = uint64_t(1) << (config.NumCacheBucketBits - 1);
+        uint64_t bucketSize = VERTEX_CACHE_ENTRY_SIZE_IN_DWORDS * config.NumCacheEntriesPerBucket * sizeof(GLuint);
+        uint64_t cachedVertexSize = GetVertexCacheVertexSizeInDwords(config) * sizeof(uint32_t);
+        uint64_t lockSize = GetVertexCacheLockSizeInDwords(config) * sizeof(GLuint);
+
+        if (mode == PULLER_OBJ_SOFTCACHE_MODE)
+        {
+            addBuffer(kIndexSize, numCorners, numCorners);
+            addBuffer(kIndexSize, numCorners, numCorners);
+            addBuffer(kXYZWSize, numPositions, numVerts);
+            addBuffer(kXYZWSize, numNormals, numVerts);
+        }
+        else
+        {
+            addBuffer(kIndexSize, numIndices, numIndices);
+            addBuffer(kXYZWSize, numVerts, numVerts);
+            addBuffer(kXYZWSize, numVerts, numVerts);
+        }
+
+        addBuffer(GetVertexCacheMaxVertexSizeInDwords() * sizeof(uint32_t), numCorners, 0);
+        addAccesses(cachedVertexSize, numCorners);
+        addBuffer(bucketSize, numBuckets, numCorners);
+        addAccesses(VERTEX_CACHE_ENTRY_SIZE_IN_DWORDS * sizeof(GLuint), numVerts);
+        addBuffer(lockSize, numBuckets, numCorners + numVerts);
+        addBuffer(sizeof(GLuint), 1, numVerts);
+        break;
+    }
+    case PULLER_PRETRANSFORMED_MODE:
+        // the compute pass reads every merged vertex and writes it transformed, the draw pulls the transformed vertices
+        addBuffer(kIndexSize, numIndices, numIndices);
+        addBuffer(kXYZWSize, numVerts, numVerts);
+        addBuffer(kXYZWSize, numVerts, numVerts);
+        addBuffer(kTransformedVertexSize, numVerts, numVerts + numIndices);
+        break;
+    case PULLER_OBJ_PRETRANSFORMED_MODE:
+        addBuffer(kIndexSize, numCorners, numCorners);
+        addBuffer(kIndexSize, numCorners, numCorners);
+        addBuffer(kXYZWSize, numPositions, numPositions);
+        addBuffer(kXYZWSize, numNormals, numNormals);
+        addBuffer(TRANSFORMED_POSITION_SIZE_IN_DWORDS * sizeof(uint32_t), numPositions, numPositions + numCorners);
+        addBuffer(TRANSFORMED_NORMAL_SIZE_IN_DWORDS * sizeof(uint32_t), numNormals, numNormals + numCorners);
+        break;
+    case FETCHER_DEDUPLICATED_MODE:
+        // the inputs and scratch buffers of the merge pass are resident, but only used when the mesh is rebuilt
+        addBuffer(kIndexSize, numCorners, 0);
+        addBuffer(kIndexSize, numCorners, 0);
+        addBuffer(kXYZWSize, numPositions, 0);
+        addBuffer(kXYZWSize, numNormals, 0);
+        addBuffer(DEDUP_SLOT_SIZE_IN_DWORDS * sizeof(uint32_t), model.numDedupSlots, 0);
+        addBuffer(kIndexSize, numCorners, numCorners);
+        addBuffer(kXYZWSize, numCorners, numCorners);
+        addBuffer(kXYZWSize, numCorners, numCorners);
+        break;
+    case PULLER_BATCH_DEDUP_MODE:
+        // at most every index of a batch is a new vertex, so the batch-local vertices are counted once per index
+        addBuffer(kIndexSize, numIndices, numIndices);
+        addBuffer(kXYZWSize, numVerts, numIndices);
+        addBuffer(kXYZWSize, numVerts, numIndices);
+        addBuffer(kTransformedVertexSize, uint64_t(model.numDedupBatches) * DEDUP_BATCH_SIZE, numIndices * 2);
+        addBuffer(kIndexSize, numIndices, numIndices * 2);
+        break;
+    case PULLER_CAPTURED_MODE:
+        // assumes the camera moves, so the vertices are captured every frame
+        addBuffer(kIndexSize, numIndices, numIndices);
+        addBuffer(kXYZWSize, numVerts, numVerts);
+        addBuffer(kXYZWSize, numVerts, numVerts);
+        addBuffer(kTransformedVertexSize, numVerts, numVerts + numIndices);
+        break;
+    case PULLER_DERIVATIVE_NORMAL_MODE:
+        addBuffer(kIndexSize, numIndices, numIndices);
+        addBuffer(kXYZWSize, numVerts, numIndices);
+        break;
+    default:
+        assert(!"unknown mode");
+        break;
+    }
+
+    // the depth prepass reads the indices and positions a second time
+    if (depthPrepassEnabled && IsDepthPrepassMode(mode))
+    {
+        uint64_t positionSize =
+            mode == FIXED_FUNCTION_SOA_MODE || mode == PULLER_SSBO_SOA_MODE ? 3 * kComponentSize :
+            mode == FIXED_FUNCTION_INTERLEAVED_MODE ? kXYZSize :
+            kXYZWSize;
+        addAccesses(kIndexSize + positionSize, numCorners);
+    }
+
+    footprint.VerticesPerFrame = numCorners;
+    footprint.BytesPerVertex = numCorners == 0 ? 0.0 : double(footprint.BytesPerFrame) / double(numCorners);
+    return footprint;
+}
+
+void BuddhaDemo::readbackSoftVertexCacheInstrumentation(VertexPullingMode mode)
+{
+    const SoftVertexCacheConfig& config = softVertexCacheConfig;
+    int numBuckets = 1 << (config.NumCacheBucketBits - 1);
+    GLsizei sizeInDwords = VERTEX_CACHE_INSTRUMENTATION_HEADER_SIZE_IN_DWORDS + config.NumCacheEntriesPerBucket + numBuckets;
+
+    // pick up the results of previous frames' copies, without waiting for the GPU.
+    while (const GLuint* pData = (const GLuint*)vertexCacheInstrumentationReadback.Peek(NULL, NULL))
+    {
+        SoftVertexCacheInstrumentation& instrumentation = lastVertexCacheInstrumentation;
+        instrumentation.ReadLockFailures = (int)pData[0];
+        instrumentation.WriteLockFailures = (int)pData[1];
+        instrumentation.Evictions = (int)pData[2];
+
+        const GLuint* pWayHits = pData + VERTEX_CACHE_INSTRUMENTATION_HEADER_SIZE_IN_DWORDS;
+        instrumentation.WayHits.assign(pWayHits, pWayHits + config.NumCacheEntriesPerBucket);
+
+        const GLuint* pBucketAccesses = pWayHits + config.NumCacheEntriesPerBucket;
+        instrumentation.BucketAccesses.assign(pBucketAccesses, pBucketAccesses + numBuckets);
+
+        vertexCacheInstrumentationReadback.Pop();
+
+        hasVertexCacheInstrumentation = true;
+    }
+
+    // start a new readback of this frame's data. The counters were written with atomics by the vertex shader.
+    if (IsSoftVertexCacheMode(mode) && config.EnableCacheInstrumentation)
+    {
+        barrierTracker.BeginPass("Cache instrumentation readback");
+        barrierTracker.Read(vertexCacheInstrumentationBuffer, BUFFER_ACCESS_BUFFER_UPDATE);
+        barrierTracker.IssueBarrier();
+        vertexCacheInstrumentationReadback.Enqueue(vertexCacheInstrumentationBuffer, sizeInDwords * sizeof(GLuint), 0);
+        barrierTracker.EndPass();
+    }
+}
+
+// reads the results of a frame's timer queries into availableFrameTimings.
+// returns false if they aren't available yet and wait is false.
+bool BuddhaDemo::readFrameTimerQueries(FrameTimerQueries* pQueries, bool wait)
+{
+    if (!pQueries->isPending)
+    {
+        return true;
+    }
+
+    // the draw query is the last one of the frame, and results of queries of the same target become available in order
+    if (!wait)
+    {
+        GLuint available;
+        glGetQueryObjectuiv(pQueries->timeElapsedQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            return false;
+        }
+
+        // the statistics have different targets, so they are checked separately
+        if (pQueries->hasPipelineStatistics)
+        {
+            for (GLuint query : pQueries->pipelineStatisticsQueries)
+            {
+                glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    FrameTiming& timing = pQueries->timing;
+
+    glGetQueryObjectui64v(pQueries->timeElapsedQuery, GL_QUERY_RESULT, &timing.DrawNanoseconds);
+
+    timing.ComputeNanoseconds = 0;
+    if (pQueries->hasComputePass)
+        glGetQueryObjectui64v(pQueries->computeTimeElapsedQuery, GL_QUERY_RESULT, &timing.ComputeNanoseconds);
+
+    timing.DepthPrepassNanoseconds = 0;
+    if (pQueries->hasDepthPrepass)
+        glGetQueryObjectui64v(pQueries->depthPrepassTimeElapsedQuery, GL_QUERY_RESULT, &timing.DepthPrepassNanoseconds);
+
+    // the whole frame's work, so modes with extra passes can be compared with the others
+    timing.ElapsedNanoseconds = timing.ComputeNanoseconds + timing.DepthPrepassNanoseconds + timing.DrawNanoseconds;
+
+    timing.HasPipelineStatistics = pQueries->hasPipelineStatistics;
+    timing.Statistics = PipelineStatistics();
+    if (pQueries->hasPipelineStatistics)
+    {
+        GLuint64 results[NUMBER_OF_PIPELINE_STATISTICS];
+        for (size_t i = 0; i < NUMBER_OF_PIPELINE_STATISTICS; i++)
+        {
+            glGetQueryObjectui64v(pQueries->pipelineStatisticsQueries[i], GL_QUERY_RESULT, &results[i]);
+        }
+
+        timing.Statistics.VerticesSubmitted = results[0];
+        timing.Statistics.PrimitivesSubmitted = results[1];
+        timing.Statistics.VertexShaderInvocations = results[2];
+        timing.Statistics.ClippingInputPrimitives = results[3];
+        timing.Statistics.FragmentShaderInvocations = results[4];
+    }
+
+    if (!pQueries->isOffscreen)
+    {
+        availableFrameTimings.push_back(timing);
+    }
+
+    pQueries->isPending = false;
+    return true;
+}
+
+bool BuddhaDemo::PollFrameTiming(FrameTiming* pTiming)
+{
+    // oldest first, so the timings come out in the order of the frames
+    for (int i = 0; i < TIMER_QUERY_RING_SIZE; i++)
+    {
+        if (!readFrameTimerQueries(&frameTimerQueries[(nextFrameTimerQueries + i) % TIMER_QUERY_RING_SIZE], false))
+        {
+            break;
+        }
+    }
+
+    if (availableFrameTimings.empty())
+    {
+        return false;
+    }
+
+    *pTiming = availableFrameTimings.front();
+    availableFrameTimings.pop_front();
+    return true;
+}
+
+void BuddhaDemo::renderScene(int meshID, const glm::mat4& modelMatrix, int screenWidth, int screenHeight, float dtsec, VertexPullingMode mode, uint64_t* pFrameNumber)
+{
+    ProfilerScope renderSceneZone(&profiler, "renderScene");
+
+    barrierTracker.ClearLog();
+
+    // only waits if the GPU is more than TIMER_QUERY_RING_SIZE frames behind
+    FrameTimerQueries& timerQueries = frameTimerQueries[nextFrameTimerQueries];
+    readFrameTimerQueries(&timerQueries, true);
+    nextFrameTimerQueries = (nextFrameTimerQueries + 1) % TIMER_QUERY_RING_SIZE;
+
+    profiler.BeginZone("Update transforms");
+
 	// update camera position
 	cameraRotationFactor = fmodf(cameraRotationFactor + dtsec * 0.3f, 2.f * (float)M_PI);
 	camera.position = glm::vec3(sin(cameraRotationFactor) * 5.f, 0.f, cos(cameraRotationFactor) * 5.f);
@@ -923,176 +2074,370 @@ void BuddhaDemo::renderScene(int meshID, const glm::mat4& modelMatrix, int scree
 	transform.ModelViewMatrix = translate(transform.ModelViewMatrix, -camera.position);
     transform.ProjectionMatrix = glm::perspective(glm::radians(45.0f), (float)screenWidth / screenHeight, 0.1f, 40.f);
 	transform.MVPMatrix = transform.ProjectionMatrix * transform.ModelViewMatrix;
-	glBindBuffer(GL_UNIFORM_BUFFER, transformUB);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(transform), &transform);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	transform.InverseProjectionMatrix = glm::inverse(transform.ProjectionMatrix);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(0, 0, screenWidth, screenHeight);
+    // only waits if the GPU is more than TRANSFORM_RING_SIZE scenes behind
+    transformRing.BeginSegment();
+    GLintptr transformOffset = transformRing.Upload(&transform, sizeof(transform));
+    assert(transformOffset != -1);
+
+    profiler.EndZone();
+
+    int renderWidth = std::max(1, (int)(screenWidth * renderScale));
+    int renderHeight = std::max(1, (int)(screenHeight * renderScale));
+    bool isScaled = renderWidth != screenWidth || renderHeight != screenHeight;
+    if (isScaled)
+    {
+        resizeRenderTarget(&scaledRenderTarget, renderWidth, renderHeight, GL_SRGB8_ALPHA8);
+    }
+    GLuint sceneFramebuffer = isScaled ? scaledRenderTarget.framebuffer : renderTargetFramebuffer;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+    glViewport(0, 0, renderWidth, renderHeight);
 
     glClearDepth(1.f);
     glClearColor(0.f, 0.f, 0.f, 0.f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // render scene
-    glBindProgramPipeline(progPipeline[mode]);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_FRAMEBUFFER_SRGB);
+    stateCache.SetEnabled(GL_DEPTH_TEST, true);
+    stateCache.SetEnabled(GL_FRAMEBUFFER_SRGB, true);
 
-    // glBindTextureUnit lookalike for GL 4.3
-    auto bindBufferTextureUnit = [](GLuint unit, GLuint textureBuffer)
+    PerModel& model = models[meshID];
+
+    // compute passes (and the transform feedback capture) that prepare the data used by the draw. They are timed separately from the draw.
+    // the deduplicated mesh is only rebuilt when it was invalidated.
+    bool rebuildDeduplicatedMesh = mode == FETCHER_DEDUPLICATED_MODE && model.isDedupMeshStale;
+    // the captured vertices are reused until the camera changes
+    bool captureTransformedVertices = mode == PULLER_CAPTURED_MODE && (
+        !model.hasCapturedVertices ||
+        model.capturedModelViewMatrix != transform.ModelViewMatrix ||
+        model.capturedMVPMatrix != transform.MVPMatrix);
+    bool hasComputePass = mode == PULLER_PRETRANSFORMED_MODE || mode == PULLER_OBJ_PRETRANSFORMED_MODE || mode == PULLER_BATCH_DEDUP_MODE || rebuildDeduplicatedMesh || captureTransformedVertices;
+    if (hasComputePass)
     {
-        glActiveTexture(GL_TEXTURE0 + unit);
-        glBindTexture(GL_TEXTURE_BUFFER, textureBuffer);
-    };
+        ProfilerScope computeZone(&profiler, "Compute passes");
 
-    PerModel& model = models[meshID];
+        stateCache.BindUniformBufferRange(0, transformRing.GetBuffer(), transformOffset, sizeof(transform));
+
+        glBeginQuery(GL_TIME_ELAPSED, timerQueries.computeTimeElapsedQuery);
+
+        if (mode == PULLER_PRETRANSFORMED_MODE)
+        {
+            stateCache.UseProgram(pretransformProg);
+            stateCache.ResetBindings();
+            stateCache.SetStorageBuffer(0, model.positionBufferXYZW);
+            stateCache.SetStorageBuffer(1, model.normalBufferXYZW);
+            stateCache.SetStorageBuffer(2, model.transformedVertexBuffer);
+            stateCache.CommitBindings();
+
+            barrierTracker.BeginPass("Pre-transform");
+            barrierTracker.Read(model.positionBufferXYZW, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Read(model.normalBufferXYZW, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Write(model.transformedVertexBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.IssueBarrier();
+            glDispatchCompute((model.numVerts + PRETRANSFORM_WORKGROUP_SIZE - 1) / PRETRANSFORM_WORKGROUP_SIZE, 1, 1);
+            barrierTracker.EndPass();
+        }
+        else if (mode == PULLER_OBJ_PRETRANSFORMED_MODE)
+        {
+            // the two passes don't share any buffer, so no barrier is issued between them
+            stateCache.UseProgram(pretransformPositionsProg);
+            stateCache.ResetBindings();
+            stateCache.SetStorageBuffer(0, model.uniquePositionBufferXYZW);
+            stateCache.SetStorageBuffer(1, model.transformedUniquePositionBuffer);
+            stateCache.CommitBindings();
+
+            barrierTracker.BeginPass("Pre-transform positions");
+            barrierTracker.Read(model.uniquePositionBufferXYZW, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Write(model.transformedUniquePositionBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.IssueBarrier();
+            glDispatchCompute((model.numUniquePositions + PRETRANSFORM_WORKGROUP_SIZE - 1) / PRETRANSFORM_WORKGROUP_SIZE, 1, 1);
+            barrierTracker.EndPass();
+
+            stateCache.UseProgram(pretransformNormalsProg);
+            stateCache.ResetBindings();
+            stateCache.SetStorageBuffer(0, model.uniqueNormalBufferXYZW);
+            stateCache.SetStorageBuffer(1, model.transformedUniqueNormalBuffer);
+            stateCache.CommitBindings();
+
+            barrierTracker.BeginPass("Pre-transform normals");
+            barrierTracker.Read(model.uniqueNormalBufferXYZW, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Write(model.transformedUniqueNormalBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.IssueBarrier();
+            glDispatchCompute((model.numUniqueNormals + PRETRANSFORM_WORKGROUP_SIZE - 1) / PRETRANSFORM_WORKGROUP_SIZE, 1, 1);
+            barrierTracker.EndPass();
+        }
+        else if (mode == FETCHER_DEDUPLICATED_MODE)
+        {
+            const uint32_t kZero = 0;
+
+            // the clears are ordered with the dispatch by GL, only the shader writes of the previous rebuild need a barrier
+            barrierTracker.BeginPass("Dedup clears");
+            barrierTracker.Write(model.dedupSlotBuffer, BUFFER_ACCESS_BUFFER_UPDATE);
+            barrierTracker.Write(model.dedupVertexCounterBuffer, BUFFER_ACCESS_BUFFER_UPDATE);
+            barrierTracker.IssueBarrier();
+            glBindBuffer(GL_ARRAY_BUFFER, model.dedupSlotBuffer);
+            glClearBufferData(GL_ARRAY_BUFFER, GL_R32UI, GL_RED, GL_UNSIGNED_INT, &kZero);
+            glBindBuffer(GL_ARRAY_BUFFER, model.dedupVertexCounterBuffer);
+            glClearBufferData(GL_ARRAY_BUFFER, GL_R32UI, GL_RED, GL_UNSIGNED_INT, &kZero);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            barrierTracker.EndPass();
+
+            stateCache.UseProgram(dedupCornersProg);
+            stateCache.ResetBindings();
+            stateCache.SetStorageBuffer(0, model.positionIndexBuffer);
+            stateCache.SetStorageBuffer(1, model.normalIndexBuffer);
+            stateCache.SetStorageBuffer(2, model.uniquePositionBufferXYZW);
+            stateCache.SetStorageBuffer(3, model.uniqueNormalBufferXYZW);
+            stateCache.SetStorageBuffer(4, model.dedupSlotBuffer);
+            stateCache.SetStorageBuffer(5, model.dedupVertexCounterBuffer);
+            stateCache.SetStorageBuffer(6, model.dedupPositionBuffer);
+            stateCache.SetStorageBuffer(7, model.dedupNormalBuffer);
+            stateCache.SetStorageBuffer(8, model.dedupIndexBuffer);
+            stateCache.CommitBindings();
+
+            barrierTracker.BeginPass("Dedup corners");
+            barrierTracker.Read(model.positionIndexBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Read(model.normalIndexBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Read(model.uniquePositionBufferXYZW, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Read(model.uniqueNormalBufferXYZW, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Write(model.dedupSlotBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Write(model.dedupVertexCounterBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Write(model.dedupPositionBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Write(model.dedupNormalBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Write(model.dedupIndexBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.IssueBarrier();
+            glDispatchCompute((model.numUniqueVerts + DEDUP_WORKGROUP_SIZE - 1) / DEDUP_WORKGROUP_SIZE, 1, 1);
+            barrierTracker.EndPass();
+        }
+        else if (mode == PULLER_BATCH_DEDUP_MODE)
+        {
+            stateCache.UseProgram(batchDedupProg);
+            stateCache.ResetBindings();
+            stateCache.SetStorageBuffer(0, model.indexBuffer);
+            stateCache.SetStorageBuffer(1, model.positionBufferXYZW);
+            stateCache.SetStorageBuffer(2, model.normalBufferXYZW);
+            stateCache.SetStorageBuffer(3, model.batchVertexBuffer);
+            stateCache.SetStorageBuffer(4, model.batchIndexBuffer);
+            stateCache.CommitBindings();
+
+            barrierTracker.BeginPass("Batch dedup");
+            barrierTracker.Read(model.indexBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Read(model.positionBufferXYZW, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Read(model.normalBufferXYZW, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Write(model.batchVertexBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Write(model.batchIndexBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.IssueBarrier();
+            glDispatchCompute(model.numDedupBatches, 1, 1);
+            barrierTracker.EndPass();
+        }
+        else if (mode == PULLER_CAPTURED_MODE)
+        {
+            // one point per merged vertex, nothing is rasterized
+            stateCache.UseProgram(captureProg);
+            stateCache.ResetBindings();
+            stateCache.SetStorageBuffer(0, model.positionBufferXYZW);
+            stateCache.SetStorageBuffer(1, model.normalBufferXYZW);
+            stateCache.CommitBindings();
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, model.capturedVertexBuffer);
+            stateCache.BindVertexArray(model.nullVertexArray);
+
+            // transform feedback writes are ordered with the draw by GL, so the draw needs no barrier to read them
+            barrierTracker.BeginPass("Capture");
+            barrierTracker.Read(model.positionBufferXYZW, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Read(model.normalBufferXYZW, BUFFER_ACCESS_SHADER_STORAGE);
+            barrierTracker.Write(model.capturedVertexBuffer, BUFFER_ACCESS_TRANSFORM_FEEDBACK);
+            barrierTracker.IssueBarrier();
+            glEnable(GL_RASTERIZER_DISCARD);
+            glBeginTransformFeedback(GL_POINTS);
+            glDrawArrays(GL_POINTS, 0, model.numVerts);
+            glEndTransformFeedback();
+            glDisable(GL_RASTERIZER_DISCARD);
+            barrierTracker.EndPass();
+
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+
+            model.hasCapturedVertices = true;
+            model.capturedModelViewMatrix = transform.ModelViewMatrix;
+            model.capturedMVPMatrix = transform.MVPMatrix;
+        }
+
+        glEndQuery(GL_TIME_ELAPSED);
+
+        // the storage buffers of the compute passes are unbound by the draw's commit, unless the draw uses them too
+        stateCache.UseProgram(0);
+    }
+
+    profiler.BeginZone("Bind state");
+
+    stateCache.BindProgramPipeline(progPipeline[mode]);
+    stateCache.ResetBindings();
 
     if (mode == FETCHER_AOS_1RGBAFETCH_MODE)
     {
-        bindBufferTextureUnit(0, model.positionTexBufferRGBA32F);
-        bindBufferTextureUnit(1, model.normalTexBufferRGBA32F);
+        stateCache.SetTextureBuffer(0, model.positionTexBufferRGBA32F);
+        stateCache.SetTextureBuffer(1, model.normalTexBufferRGBA32F);
     }
     else if (mode == FETCHER_AOS_1RGBFETCH_MODE)
     {
-        bindBufferTextureUnit(0, model.positionTexBufferRGB32F);
-        bindBufferTextureUnit(1, model.normalTexBufferRGB32F);
+        stateCache.SetTextureBuffer(0, model.positionTexBufferRGB32F);
+        stateCache.SetTextureBuffer(1, model.normalTexBufferRGB32F);
     }
     else if (mode == FETCHER_AOS_3FETCH_MODE)
     {
-        bindBufferTextureUnit(0, model.positionTexBufferR32F);
-        bindBufferTextureUnit(1, model.normalTexBufferR32F);
+        stateCache.SetTextureBuffer(0, model.positionTexBufferR32F);
+        stateCache.SetTextureBuffer(1, model.normalTexBufferR32F);
     }
     else if (mode == FETCHER_SOA_MODE)
     {
-        bindBufferTextureUnit(0, model.positionXTexBufferR32F);
-        bindBufferTextureUnit(1, model.positionYTexBufferR32F);
-        bindBufferTextureUnit(2, model.positionZTexBufferR32F);
-        bindBufferTextureUnit(3, model.normalXTexBufferR32F);
-        bindBufferTextureUnit(4, model.normalYTexBufferR32F);
-        bindBufferTextureUnit(5, model.normalZTexBufferR32F);
+        stateCache.SetTextureBuffer(0, model.positionXTexBufferR32F);
+        stateCache.SetTextureBuffer(1, model.positionYTexBufferR32F);
+        stateCache.SetTextureBuffer(2, model.positionZTexBufferR32F);
+        stateCache.SetTextureBuffer(3, model.normalXTexBufferR32F);
+        stateCache.SetTextureBuffer(4, model.normalYTexBufferR32F);
+        stateCache.SetTextureBuffer(5, model.normalZTexBufferR32F);
     }
     else if (mode == FETCHER_IMAGE_AOS_1FETCH_MODE)
     {
-        glBindImageTexture(0, model.positionTexBufferRGBA32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
-        glBindImageTexture(1, model.normalTexBufferRGBA32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+        stateCache.SetImageTexture(0, model.positionTexBufferRGBA32F, GL_RGBA32F);
+        stateCache.SetImageTexture(1, model.normalTexBufferRGBA32F, GL_RGBA32F);
     }
     else if (mode == FETCHER_IMAGE_AOS_3FETCH_MODE)
     {
-        glBindImageTexture(0, model.positionTexBufferR32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
-        glBindImageTexture(1, model.normalTexBufferR32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        stateCache.SetImageTexture(0, model.positionTexBufferR32F, GL_R32F);
+        stateCache.SetImageTexture(1, model.normalTexBufferR32F, GL_R32F);
     }
     else if (mode == FETCHER_IMAGE_SOA_MODE)
     {
-        glBindImageTexture(0, model.positionXTexBufferR32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
-        glBindImageTexture(1, model.positionYTexBufferR32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
-        glBindImageTexture(2, model.positionZTexBufferR32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
-        glBindImageTexture(3, model.normalXTexBufferR32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
-        glBindImageTexture(4, model.normalYTexBufferR32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
-        glBindImageTexture(5, model.normalZTexBufferR32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        stateCache.SetImageTexture(0, model.positionXTexBufferR32F, GL_R32F);
+        stateCache.SetImageTexture(1, model.positionYTexBufferR32F, GL_R32F);
+        stateCache.SetImageTexture(2, model.positionZTexBufferR32F, GL_R32F);
+        stateCache.SetImageTexture(3, model.normalXTexBufferR32F, GL_R32F);
+        stateCache.SetImageTexture(4, model.normalYTexBufferR32F, GL_R32F);
+        stateCache.SetImageTexture(5, model.normalZTexBufferR32F, GL_R32F);
     }
     else if (mode == FETCHER_SSBO_AOS_1FETCH_MODE)
     {
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, model.positionBufferXYZW);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, model.normalBufferXYZW);
+        stateCache.SetStorageBuffer(0, model.positionBufferXYZW);
+        stateCache.SetStorageBuffer(1, model.normalBufferXYZW);
     }
     else if (mode == FETCHER_SSBO_AOS_3FETCH_MODE)
     {
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, model.positionBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, model.normalBuffer);
+        stateCache.SetStorageBuffer(0, model.positionBuffer);
+        stateCache.SetStorageBuffer(1, model.normalBuffer);
     }
     else if (mode == FETCHER_SSBO_SOA_MODE)
     {
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, model.positionXBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, model.positionYBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, model.positionZBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, model.normalXBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, model.normalYBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, model.normalZBuffer);
+        stateCache.SetStorageBuffer(0, model.positionXBuffer);
+        stateCache.SetStorageBuffer(1, model.positionYBuffer);
+        stateCache.SetStorageBuffer(2, model.positionZBuffer);
+        stateCache.SetStorageBuffer(3, model.normalXBuffer);
+        stateCache.SetStorageBuffer(4, model.normalYBuffer);
+        stateCache.SetStorageBuffer(5, model.normalZBuffer);
     }
     else if (mode == PULLER_AOS_1RGBAFETCH_MODE)
     {
-        bindBufferTextureUnit(0, model.indexTexBufferR32I);
-        bindBufferTextureUnit(1, model.positionTexBufferRGBA32F);
-        bindBufferTextureUnit(2, model.normalTexBufferRGBA32F);
+        stateCache.SetTextureBuffer(0, model.indexTexBufferR32I);
+        stateCache.SetTextureBuffer(1, model.positionTexBufferRGBA32F);
+        stateCache.SetTextureBuffer(2, model.normalTexBufferRGBA32F);
     }
     else if (mode == PULLER_AOS_1RGBFETCH_MODE)
     {
-        bindBufferTextureUnit(0, model.indexTexBufferR32I);
-        bindBufferTextureUnit(1, model.positionTexBufferRGB32F);
-        bindBufferTextureUnit(2, model.normalTexBufferRGB32F);
+        stateCache.SetTextureBuffer(0, model.indexTexBufferR32I);
+        stateCache.SetTextureBuffer(1, model.positionTexBufferRGB32F);
+        stateCache.SetTextureBuffer(2, model.normalTexBufferRGB32F);
     }
     else if (mode == PULLER_AOS_3FETCH_MODE)
     {
-        bindBufferTextureUnit(0, model.indexTexBufferR32I);
-        bindBufferTextureUnit(1, model.positionTexBufferR32F);
-        bindBufferTextureUnit(2, model.normalTexBufferR32F);
+        stateCache.SetTextureBuffer(0, model.indexTexBufferR32I);
+        stateCache.SetTextureBuffer(1, model.positionTexBufferR32F);
+        stateCache.SetTextureBuffer(2, model.normalTexBufferR32F);
     }
     else if (mode == PULLER_SOA_MODE)
     {
-        bindBufferTextureUnit(0, model.indexTexBufferR32I);
-        bindBufferTextureUnit(1, model.positionXTexBufferR32F);
-        bindBufferTextureUnit(2, model.positionYTexBufferR32F);
-        bindBufferTextureUnit(3, model.positionZTexBufferR32F);
-        bindBufferTextureUnit(4, model.normalXTexBufferR32F);
-        bindBufferTextureUnit(5, model.normalYTexBufferR32F);
-        bindBufferTextureUnit(6, model.normalZTexBufferR32F);
+        stateCache.SetTextureBuffer(0, model.indexTexBufferR32I);
+        stateCache.SetTextureBuffer(1, model.positionXTexBufferR32F);
+        stateCache.SetTextureBuffer(2, model.positionYTexBufferR32F);
+        stateCache.SetTextureBuffer(3, model.positionZTexBufferR32F);
+        stateCache.SetTextureBuffer(4, model.normalXTexBufferR32F);
+        stateCache.SetTextureBuffer(5, model.normalYTexBufferR32F);
+        stateCache.SetTextureBuffer(6, model.normalZTexBufferR32F);
     }
     else if (mode == PULLER_IMAGE_AOS_1FETCH_MODE)
     {
-        glBindImageTexture(0, model.indexTexBufferR32I, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32I);
-        glBindImageTexture(1, model.positionTexBufferRGBA32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
-        glBindImageTexture(2, model.normalTexBufferRGBA32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+        stateCache.SetImageTexture(0, model.indexTexBufferR32I, GL_R32I);
+        stateCache.SetImageTexture(1, model.positionTexBufferRGBA32F, GL_RGBA32F);
+        stateCache.SetImageTexture(2, model.normalTexBufferRGBA32F, GL_RGBA32F);
     }
     else if (mode == PULLER_IMAGE_AOS_3FETCH_MODE)
     {
-        glBindImageTexture(0, model.indexTexBufferR32I, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32I);
-        glBindImageTexture(1, model.positionTexBufferR32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
-        glBindImageTexture(2, model.normalTexBufferR32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        stateCache.SetImageTexture(0, model.indexTexBufferR32I, GL_R32I);
+        stateCache.SetImageTexture(1, model.positionTexBufferR32F, GL_R32F);
+        stateCache.SetImageTexture(2, model.normalTexBufferR32F, GL_R32F);
     }
     else if (mode == PULLER_IMAGE_SOA_MODE)
     {
-        glBindImageTexture(0, model.indexTexBufferR32I, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32I);
-        glBindImageTexture(1, model.positionXTexBufferR32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
-        glBindImageTexture(2, model.positionYTexBufferR32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
-        glBindImageTexture(3, model.positionZTexBufferR32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
-        glBindImageTexture(4, model.normalXTexBufferR32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
-        glBindImageTexture(5, model.normalYTexBufferR32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
-        glBindImageTexture(6, model.normalZTexBufferR32F, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        stateCache.SetImageTexture(0, model.indexTexBufferR32I, GL_R32I);
+        stateCache.SetImageTexture(1, model.positionXTexBufferR32F, GL_R32F);
+        stateCache.SetImageTexture(2, model.positionYTexBufferR32F, GL_R32F);
+        stateCache.SetImageTexture(3, model.positionZTexBufferR32F, GL_R32F);
+        stateCache.SetImageTexture(4, model.normalXTexBufferR32F, GL_R32F);
+        stateCache.SetImageTexture(5, model.normalYTexBufferR32F, GL_R32F);
+        stateCache.SetImageTexture(6, model.normalZTexBufferR32F, GL_R32F);
+    }
+    else if (mode == PULLER_SSBO_AOS_1FETCH_MODE || mode == PULLER_SSBO_SUBGROUP_MODE)
+    {
+        stateCache.SetStorageBuffer(0, model.indexBuffer);
+        stateCache.SetStorageBuffer(1, model.positionBufferXYZW);
+        stateCache.SetStorageBuffer(2, model.normalBufferXYZW);
     }
-    else if (mode == PULLER_SSBO_AOS_1FETCH_MODE)
+    else if (mode == PULLER_DERIVATIVE_NORMAL_MODE)
     {
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, model.indexBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, model.positionBufferXYZW);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, model.normalBufferXYZW);
+        // the normals are derived in the fragment shader, so only the positions are pulled
+        stateCache.SetStorageBuffer(0, model.indexBuffer);
+        stateCache.SetStorageBuffer(1, model.positionBufferXYZW);
     }
     else if (mode == PULLER_SSBO_AOS_3FETCH_MODE)
     {
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, model.indexBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, model.positionBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, model.normalBuffer);
+        stateCache.SetStorageBuffer(0, model.indexBuffer);
+        stateCache.SetStorageBuffer(1, model.positionBuffer);
+        stateCache.SetStorageBuffer(2, model.normalBuffer);
     }
     else if (mode == PULLER_SSBO_SOA_MODE)
     {
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, model.indexBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, model.positionXBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, model.positionYBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, model.positionZBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, model.normalXBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, model.normalYBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, model.normalZBuffer);
+        stateCache.SetStorageBuffer(0, model.indexBuffer);
+        stateCache.SetStorageBuffer(1, model.positionXBuffer);
+        stateCache.SetStorageBuffer(2, model.positionYBuffer);
+        stateCache.SetStorageBuffer(3, model.positionZBuffer);
+        stateCache.SetStorageBuffer(4, model.normalXBuffer);
+        stateCache.SetStorageBuffer(5, model.normalYBuffer);
+        stateCache.SetStorageBuffer(6, model.normalZBuffer);
     }
-    else if (mode == PULLER_OBJ_MODE)
+    else if (mode == PULLER_OBJ_MODE || mode == PULLER_OBJ_SUBGROUP_MODE || mode == GS_PULLER_MODE || mode == GS_PULLER_FACE_NORMAL_MODE)
     {
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, model.positionIndexBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, model.normalIndexBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, model.uniquePositionBufferXYZW);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, model.uniqueNormalBufferXYZW);
+        stateCache.SetStorageBuffer(0, model.positionIndexBuffer);
+        stateCache.SetStorageBuffer(1, model.normalIndexBuffer);
+        stateCache.SetStorageBuffer(2, model.uniquePositionBufferXYZW);
+        stateCache.SetStorageBuffer(3, model.uniqueNormalBufferXYZW);
     }
-    else if (mode == PULLER_OBJ_SOFTCACHE_MODE)
+    else if (IsSoftVertexCacheMode(mode))
     {
-        // make sure any previous reads/writes of these buffers are done before resetting them
-        glMemoryBarrier(GL_ALL_BARRIER_BITS);
+        profiler.BeginZone("Soft cache clears");
+
+        bool hasCacheMissCounter = GetSoftVertexCacheConfig().EnableCacheMissCounter;
+        bool hasCacheInstrumentation = GetSoftVertexCacheConfig().EnableCacheInstrumentation;
+
+        // the previous draw's atomics must land before the buffers are reset
+        barrierTracker.BeginPass("Soft cache clears");
+        barrierTracker.Write(vertexCacheCounterBuffer, BUFFER_ACCESS_BUFFER_UPDATE);
+        barrierTracker.Write(vertexCacheBucketsBuffer, BUFFER_ACCESS_BUFFER_UPDATE);
+        barrierTracker.Write(vertexCacheBucketLocksBuffer, BUFFER_ACCESS_BUFFER_UPDATE);
+        if (hasCacheMissCounter)
+            barrierTracker.Write(vertexCacheMissCounterBuffer, BUFFER_ACCESS_BUFFER_UPDATE);
+        if (hasCacheInstrumentation)
+            barrierTracker.Write(vertexCacheInstrumentationBuffer, BUFFER_ACCESS_BUFFER_UPDATE);
+        barrierTracker.IssueBarrier();
 
         const uint32_t kZero = 0;
         glBindBuffer(GL_ARRAY_BUFFER, vertexCacheCounterBuffer);
@@ -1109,38 +2454,149 @@ void BuddhaDemo::renderScene(int meshID, const glm::mat4& modelMatrix, int scree
         glClearBufferData(GL_ARRAY_BUFFER, GL_R32UI, GL_RED, GL_UNSIGNED_INT, &kUnlocked);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, model.positionIndexBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, model.normalIndexBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, model.uniquePositionBufferXYZW);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, model.uniqueNormalBufferXYZW);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, vertexCacheCounterBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, model.vertexCacheBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, vertexCacheBucketsBuffer);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, vertexCacheBucketLocksBuffer);
-        
-        if (GetSoftVertexCacheConfig().EnableCacheMissCounter)
+        if (hasCacheMissCounter)
         {
             glBindBuffer(GL_ARRAY_BUFFER, vertexCacheMissCounterBuffer);
             glClearBufferData(GL_ARRAY_BUFFER, GL_R32UI, GL_RED, GL_UNSIGNED_INT, &kZero);
             glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
 
-            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, vertexCacheMissCounterBuffer);
+        if (hasCacheInstrumentation)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, vertexCacheInstrumentationBuffer);
+            glClearBufferData(GL_ARRAY_BUFFER, GL_R32UI, GL_RED, GL_UNSIGNED_INT, &kZero);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
         }
+
+        barrierTracker.EndPass();
+
+        profiler.EndZone();
+
+        if (mode == PULLER_OBJ_SOFTCACHE_MODE)
+        {
+            stateCache.SetStorageBuffer(0, model.positionIndexBuffer);
+            stateCache.SetStorageBuffer(1, model.normalIndexBuffer);
+            stateCache.SetStorageBuffer(2, model.uniquePositionBufferXYZW);
+            stateCache.SetStorageBuffer(3, model.uniqueNormalBufferXYZW);
+        }
+        else
+        {
+            stateCache.SetStorageBuffer(0, model.indexBuffer);
+            stateCache.SetStorageBuffer(2, model.positionBufferXYZW);
+            stateCache.SetStorageBuffer(3, model.normalBufferXYZW);
+        }
+        stateCache.SetStorageBuffer(4, vertexCacheCounterBuffer);
+        stateCache.SetStorageBuffer(5, model.vertexCacheBuffer);
+        stateCache.SetStorageBuffer(6, vertexCacheBucketsBuffer);
+        stateCache.SetStorageBuffer(7, vertexCacheBucketLocksBuffer);
+
+        if (hasCacheMissCounter)
+        {
+            stateCache.SetStorageBuffer(8, vertexCacheMissCounterBuffer);
+        }
+
+        if (hasCacheInstrumentation)
+        {
+            stateCache.SetStorageBuffer(9, vertexCacheInstrumentationBuffer);
+        }
+    }
+    else if (mode == PULLER_PRETRANSFORMED_MODE)
+    {
+        stateCache.SetStorageBuffer(0, model.indexBuffer);
+        stateCache.SetStorageBuffer(1, model.transformedVertexBuffer);
+    }
+    else if (mode == PULLER_CAPTURED_MODE)
+    {
+        stateCache.SetStorageBuffer(0, model.indexBuffer);
+        stateCache.SetStorageBuffer(1, model.capturedVertexBuffer);
+    }
+    else if (mode == PULLER_BATCH_DEDUP_MODE)
+    {
+        stateCache.SetStorageBuffer(0, model.batchIndexBuffer);
+        stateCache.SetStorageBuffer(1, model.batchVertexBuffer);
+    }
+    else if (mode == FETCHER_DEDUPLICATED_MODE)
+    {
+        stateCache.SetStorageBuffer(0, model.dedupPositionBuffer);
+        stateCache.SetStorageBuffer(1, model.dedupNormalBuffer);
+    }
+    else if (mode == PULLER_OBJ_PRETRANSFORMED_MODE)
+    {
+        stateCache.SetStorageBuffer(0, model.positionIndexBuffer);
+        stateCache.SetStorageBuffer(1, model.normalIndexBuffer);
+        stateCache.SetStorageBuffer(2, model.transformedUniquePositionBuffer);
+        stateCache.SetStorageBuffer(3, model.transformedUniqueNormalBuffer);
+    }
+    else if (mode == VISIBILITY_BUFFER_MODE)
+    {
+        // the first pass writes to the visibility buffer instead of the scene
+        resizeRenderTarget(&visibilityRenderTarget, renderWidth, renderHeight, GL_R32UI);
+        glBindFramebuffer(GL_FRAMEBUFFER, visibilityRenderTarget.framebuffer);
+
+        const GLuint kEmptyVisibility[4] = { 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF };
+        const GLfloat kFarDepth = 1.0f;
+        glClearBufferuiv(GL_COLOR, 0, kEmptyVisibility);
+        glClearBufferfv(GL_DEPTH, 0, &kFarDepth);
+
+        stateCache.SetStorageBuffer(0, model.positionIndexBuffer);
+        stateCache.SetStorageBuffer(1, model.normalIndexBuffer);
+        stateCache.SetStorageBuffer(2, model.uniquePositionBufferXYZW);
+        stateCache.SetStorageBuffer(3, model.uniqueNormalBufferXYZW);
     }
     else if (mode == GS_ASSEMBLER_MODE)
     {
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, model.uniquePositionBufferXYZW);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, model.uniqueNormalBufferXYZW);
+        stateCache.SetStorageBuffer(0, model.uniquePositionBufferXYZW);
+        stateCache.SetStorageBuffer(1, model.uniqueNormalBufferXYZW);
     }
     else if (mode == TS_ASSEMBLER_MODE)
     {
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, model.uniquePositionBufferXYZW);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, model.uniqueNormalBufferXYZW);
+        stateCache.SetStorageBuffer(0, model.uniquePositionBufferXYZW);
+        stateCache.SetStorageBuffer(1, model.uniqueNormalBufferXYZW);
     }
 
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, transformUB);
+    stateCache.CommitBindings();
+    stateCache.BindUniformBufferRange(0, transformRing.GetBuffer(), transformOffset, sizeof(transform));
+    stateCache.BindVertexArray(model.drawCmd[mode].vertexArray);
 
-    glBindVertexArray(model.drawCmd[mode].vertexArray);
+    // the depth prepass and the draw only need to declare the buffers written on the GPU, the others are only written when the mesh is loaded
+    barrierTracker.BeginPass("Draw");
+    if (mode == PULLER_PRETRANSFORMED_MODE)
+    {
+        barrierTracker.Read(model.transformedVertexBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+    }
+    else if (mode == PULLER_OBJ_PRETRANSFORMED_MODE)
+    {
+        barrierTracker.Read(model.transformedUniquePositionBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+        barrierTracker.Read(model.transformedUniqueNormalBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+    }
+    else if (mode == PULLER_CAPTURED_MODE)
+    {
+        barrierTracker.Read(model.capturedVertexBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+    }
+    else if (mode == PULLER_BATCH_DEDUP_MODE)
+    {
+        barrierTracker.Read(model.batchIndexBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+        barrierTracker.Read(model.batchVertexBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+    }
+    else if (mode == FETCHER_DEDUPLICATED_MODE)
+    {
+        barrierTracker.Read(model.dedupPositionBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+        barrierTracker.Read(model.dedupNormalBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+        barrierTracker.Read(model.dedupIndexBuffer, BUFFER_ACCESS_ELEMENT_ARRAY);
+    }
+    else if (IsSoftVertexCacheMode(mode))
+    {
+        // the cache is read and written with atomics
+        barrierTracker.Write(vertexCacheCounterBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+        barrierTracker.Write(model.vertexCacheBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+        barrierTracker.Write(vertexCacheBucketsBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+        barrierTracker.Write(vertexCacheBucketLocksBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+        if (GetSoftVertexCacheConfig().EnableCacheMissCounter)
+            barrierTracker.Write(vertexCacheMissCounterBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+        if (GetSoftVertexCacheConfig().EnableCacheInstrumentation)
+            barrierTracker.Write(vertexCacheInstrumentationBuffer, BUFFER_ACCESS_SHADER_STORAGE);
+    }
+    barrierTracker.IssueBarrier();
 
     if (model.drawCmd[mode].primType == GL_PATCHES)
     {
@@ -1155,37 +2611,114 @@ void BuddhaDemo::renderScene(int meshID, const glm::mat4& modelMatrix, int scree
         assert(model.drawCmd[mode].patchVertices == 0);
     }
 
-    glBeginQuery(GL_TIME_ELAPSED, timeElapsedQuery);
+    profiler.EndZone();
+
+    const DrawCommand& drawCmd = model.drawCmd[mode];
+    auto issueDrawCommand = [&drawCmd]()
+    {
+        if (drawCmd.drawType == DRAWCMD_DRAWARRAYS)
+        {
+            assert(drawCmd.drawArrays.count >= 1);
+
+            glDrawArraysInstancedBaseInstance(
+                drawCmd.primType,
+                drawCmd.drawArrays.first,
+                drawCmd.drawArrays.count,
+                drawCmd.drawArrays.instanceCount,
+                drawCmd.drawArrays.baseInstance);
+        }
+        else if (drawCmd.drawType == DRAWCMD_DRAWELEMENTS)
+        {
+            glDrawElementsInstancedBaseVertexBaseInstance(
+                drawCmd.primType,
+                drawCmd.drawElements.count,
+                GL_UNSIGNED_INT,
+                (GLuint*)0 + drawCmd.drawElements.firstIndex,
+                drawCmd.drawElements.instanceCount,
+                drawCmd.drawElements.baseVertex,
+                drawCmd.drawElements.baseInstance);
+        }
+        else
+        {
+            assert(!"invalid drawType");
+        }
+    };
 
-    if (model.drawCmd[mode].drawType == DRAWCMD_DRAWARRAYS)
+    // the depth prepass uses the same bindings as the main pass, but only reads the positions.
+    // the main pass then only shades the visible fragments.
+    bool hasDepthPrepass = depthPrepassEnabled && IsDepthPrepassMode(mode);
+    if (hasDepthPrepass)
     {
-        assert(model.drawCmd[mode].drawArrays.count >= 1);
+        ProfilerScope depthPrepassZone(&profiler, "Depth prepass");
 
-        glDrawArraysInstancedBaseInstance(
-            model.drawCmd[mode].primType,
-            model.drawCmd[mode].drawArrays.first,
-            model.drawCmd[mode].drawArrays.count,
-            model.drawCmd[mode].drawArrays.instanceCount,
-            model.drawCmd[mode].drawArrays.baseInstance);
+        stateCache.BindProgramPipeline(depthPrepassPipeline[mode]);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+        glBeginQuery(GL_TIME_ELAPSED, timerQueries.depthPrepassTimeElapsedQuery);
+        issueDrawCommand();
+        glEndQuery(GL_TIME_ELAPSED);
+
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_EQUAL);
+        stateCache.BindProgramPipeline(progPipeline[mode]);
     }
-    else if (model.drawCmd[mode].drawType == DRAWCMD_DRAWELEMENTS)
+
+    profiler.BeginZone("Draw");
+
+    glBeginQuery(GL_TIME_ELAPSED, timerQueries.timeElapsedQuery);
+
+    bool hasPipelineStatistics = pipelineStatisticsEnabled;
+    if (hasPipelineStatistics)
     {
-        glDrawElementsInstancedBaseVertexBaseInstance(
-            model.drawCmd[mode].primType,
-            model.drawCmd[mode].drawElements.count,
-            GL_UNSIGNED_INT,
-            (GLuint*)0 + model.drawCmd[mode].drawElements.firstIndex,
-            model.drawCmd[mode].drawElements.instanceCount,
-            model.drawCmd[mode].drawElements.baseVertex,
-            model.drawCmd[mode].drawElements.baseInstance);
+        for (size_t i = 0; i < NUMBER_OF_PIPELINE_STATISTICS; i++)
+        {
+            glBeginQuery(kPipelineStatisticsTargets[i], timerQueries.pipelineStatisticsQueries[i]);
+        }
     }
-    else
+
+    issueDrawCommand();
+
+    // second pass of the visibility buffer mode: shade every covered pixel of the scene using the IDs from the first pass
+    if (mode == VISIBILITY_BUFFER_MODE)
     {
-        assert(!"invalid drawType");
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+        stateCache.BindProgramPipeline(visibilityResolvePipeline);
+        stateCache.BindVertexArray(model.nullVertexArray);
+
+        // on top of the storage buffers of the first pass, which the resolve reads too
+        stateCache.SetTexture(0, GL_TEXTURE_2D, visibilityRenderTarget.colorTexture);
+        stateCache.CommitBindings();
+
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        // unbound right away, so a resized render target doesn't leave a deleted name in the cache
+        stateCache.SetTexture(0, GL_TEXTURE_2D, 0);
+        stateCache.CommitBindings();
+    }
+
+    if (hasPipelineStatistics)
+    {
+        for (size_t i = 0; i < NUMBER_OF_PIPELINE_STATISTICS; i++)
+        {
+            glEndQuery(kPipelineStatisticsTargets[i]);
+        }
     }
 
     glEndQuery(GL_TIME_ELAPSED);
 
+    barrierTracker.EndPass();
+
+    profiler.EndZone();
+
+    profiler.BeginZone("Restore state");
+
+    if (hasDepthPrepass)
+    {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+
     if (model.drawCmd[mode].primType == GL_PATCHES)
     {
         const float kDefaultInner[2] = { 1,1 };
@@ -1196,51 +2729,88 @@ void BuddhaDemo::renderScene(int meshID, const glm::mat4& modelMatrix, int scree
         glPatchParameterfv(GL_PATCH_DEFAULT_INNER_LEVEL, kDefaultInner);
     }
 
-    glBindVertexArray(0);
-    
-    // unbind all resources to attempt to prevent GL from thinking one resource is being used in 2 ways simultaneously.
-    for (int i = 0; i < 16; i++)
-    {
-        bindBufferTextureUnit(i, 0);
-    }
-    for (int i = 0; i < 16; i++)
+    // the resources, pipeline and vertex array stay bound until the next renderScene changes them, its commit unbinds
+    // the resources it doesn't use. The GUI saves and restores the state it changes, and disables the depth test itself.
+    // sRGB conversion would also apply to the upscale blit and the GUI.
+    stateCache.SetEnabled(GL_FRAMEBUFFER_SRGB, false);
+
+    // every command that reads this scene's transforms has been issued
+    transformRing.EndSegment();
+
+    profiler.EndZone();
+
+    if (isScaled)
     {
-        glBindImageTexture(i, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R8);
+        ProfilerScope upscaleZone(&profiler, "Upscale");
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, scaledRenderTarget.framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, renderTargetFramebuffer);
+        glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, screenWidth, screenHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
-    for (int i = 0; i < 16; i++)
+
+    // the times are read later, by PollFrameTiming or when this entry of the ring is used again
+    timerQueries.isPending = true;
+    timerQueries.isOffscreen = renderTargetFramebuffer != 0;
+    timerQueries.hasComputePass = hasComputePass;
+    timerQueries.hasDepthPrepass = hasDepthPrepass;
+    timerQueries.hasPipelineStatistics = hasPipelineStatistics;
+    timerQueries.timing = FrameTiming();
+    timerQueries.timing.FrameNumber = nextFrameNumber;
+    timerQueries.timing.MeshID = meshID;
+    timerQueries.timing.Mode = mode;
+    timerQueries.timing.SoftVertexCacheLockStrategy = GetSoftVertexCacheConfig().LockStrategy;
+
+    if (pFrameNumber)
+        *pFrameNumber = nextFrameNumber;
+    nextFrameNumber++;
+
+    ProfilerScope readbackZone(&profiler, "Readbacks");
+
+    // the GPU counters are read back asynchronously, so the values picked up here are from a few frames ago
+    uint64_t readbackMeshID;
+
+    while (const GLuint* pNumDedupVerts = (const GLuint*)dedupVertexCounterReadback.Peek(&readbackMeshID, NULL))
     {
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+        models[readbackMeshID].numDedupVerts = (int)*pNumDedupVerts;
+        dedupVertexCounterReadback.Pop();
     }
 
-    glDisable(GL_FRAMEBUFFER_SRGB);
-    glDisable(GL_DEPTH_TEST);
-    glBindProgramPipeline(0);
+    // if the ring is full the count is skipped, the previous one is still shown.
+    if (rebuildDeduplicatedMesh)
+    {
+        barrierTracker.BeginPass("Dedup counter readback");
+        barrierTracker.Read(model.dedupVertexCounterBuffer, BUFFER_ACCESS_BUFFER_UPDATE);
+        barrierTracker.IssueBarrier();
+        dedupVertexCounterReadback.Enqueue(model.dedupVertexCounterBuffer, sizeof(GLuint), meshID);
+        barrierTracker.EndPass();
 
-    if (elapsedNanoseconds)
-        glGetQueryObjectui64v(timeElapsedQuery, GL_QUERY_RESULT, elapsedNanoseconds);
+        model.isDedupMeshStale = false;
+    }
 
-    if (mode == PULLER_OBJ_SOFTCACHE_MODE && GetSoftVertexCacheConfig().EnableCacheMissCounter)
+    while (const GLuint* pNumCacheMisses = (const GLuint*)vertexCacheMissCounterReadback.Peek(&readbackMeshID, NULL))
     {
-        glMemoryBarrier(GL_ALL_BARRIER_BITS);
-
-        glBindBuffer(GL_COPY_READ_BUFFER, vertexCacheMissCounterBuffer);
-        glBindBuffer(GL_COPY_WRITE_BUFFER, vertexCacheMissCounterReadbackBuffer);
-        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint));
-        glBindBuffer(GL_COPY_READ_BUFFER, 0);
-        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        lastFrameNumVertexCacheMisses = (int)*pNumCacheMisses;
+        lastFrameMeshID = (int)readbackMeshID;
+        vertexCacheMissCounterReadback.Pop();
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, vertexCacheMissCounterReadbackBuffer);
-        GLuint* pFinalCounter = (GLuint*)glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(GLuint), GL_MAP_READ_BIT);
-        lastFrameNumVertexCacheMisses = *pFinalCounter;
-        glUnmapBuffer(GL_ARRAY_BUFFER);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (IsSoftVertexCacheMode(mode) && GetSoftVertexCacheConfig().EnableCacheMissCounter)
+    {
+        // the counter was incremented with atomics by the vertex shader
+        barrierTracker.BeginPass("Cache miss counter readback");
+        barrierTracker.Read(vertexCacheMissCounterBuffer, BUFFER_ACCESS_BUFFER_UPDATE);
+        barrierTracker.IssueBarrier();
+        vertexCacheMissCounterReadback.Enqueue(vertexCacheMissCounterBuffer, sizeof(GLuint), meshID);
+        barrierTracker.EndPass();
     }
     else
     {
         lastFrameNumVertexCacheMisses = 0;
+        lastFrameMeshID = meshID;
     }
 
-    lastFrameMeshID = meshID;
+    readbackSoftVertexCacheInstrumentation(mode);
 }
 
 } /* namespace buddha */
@@ -12,6 +12,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #define DEFAULT_SCREEN_WIDTH      1024
 #define DEFAULT_SCREEN_HEIGHT     768
@@ -20,6 +21,9 @@
 
 namespace buddha {
 
+class Profiler;
+struct PassMemoryBarrier;
+
 enum VertexPullingMode
 {
     // fixed-function vertex pulling
@@ -51,17 +55,132 @@ enum VertexPullingMode
     PULLER_SSBO_SOA_MODE,
     PULLER_OBJ_MODE,
     PULLER_OBJ_SOFTCACHE_MODE,
+    PULLER_SSBO_SOFTCACHE_MODE,
+    // share transformed vertices between invocations of a subgroup (falls back to the plain puller shaders if unsupported)
+    PULLER_SSBO_SUBGROUP_MODE,
+    PULLER_OBJ_SUBGROUP_MODE,
+    // transform every vertex once in a compute pass, then pull the transformed vertices
+    PULLER_PRETRANSFORMED_MODE,
+    // transform unique positions and unique normals in separate compute passes, then pull them with the OBJ-style indices
+    PULLER_OBJ_PRETRANSFORMED_MODE,
+    // merge OBJ-style corners into unique vertices on the GPU, then draw them indexed
+    FETCHER_DEDUPLICATED_MODE,
+    // deduplicate and transform fixed-size batches of indices in compute workgroups, then pull the batch-local vertices
+    PULLER_BATCH_DEDUP_MODE,
     //
     GS_ASSEMBLER_MODE,
+    TS_ASSEMBLER_MODE,
+    // draw one point per triangle, and pull the whole triangle in the GS
+    GS_PULLER_MODE,
+    // write triangle IDs in a first pass, then pull and interpolate the attributes per pixel in a full-screen pass
+    VISIBILITY_BUFFER_MODE,
+    // capture the transformed vertices with transform feedback when the camera changes, then pull the captured vertices
+    PULLER_CAPTURED_MODE,
+    // pull positions only, and compute the face normal from the position's screen space derivatives in the fragment shader
+    PULLER_DERIVATIVE_NORMAL_MODE,
+    // pull positions only in the geometry shader, and compute the face normal from the triangle's positions
+    GS_PULLER_FACE_NORMAL_MODE,
     //
     NUMBER_OF_MODES,
 
-    // Disabled because it doesn't work
+    // Modes that are disabled because they don't work go here
     DISABLED_MODES_START = NUMBER_OF_MODES - 1,
-    TS_ASSEMBLER_MODE,
     NUMBER_OF_MODES_INCLUDING_DISABLED_ONES
 };
 
+// Result of comparing the image rendered by a mode with the image rendered by a reference mode
+struct ModeComparisonResult
+{
+    int NumPixels;
+    int NumCoveredPixels;       // pixels covered by the mesh in either image
+    int NumDifferentPixels;     // pixels where a channel differs by more than the tolerance
+    int MaxChannelDifference;   // in 8-bit units
+};
+
+// Counts from ARB_pipeline_statistics_query for the main draw of a frame (not the compute passes or the depth prepass)
+struct PipelineStatistics
+{
+    uint64_t VerticesSubmitted;         // indices read by the input assembler
+    uint64_t PrimitivesSubmitted;
+    uint64_t VertexShaderInvocations;   // fewer than VerticesSubmitted when the post-transform cache hits
+    uint64_t ClippingInputPrimitives;
+    uint64_t FragmentShaderInvocations;
+};
+
+// GPU times of a frame rendered by renderScene. They arrive a few frames later, tagged with the frame they belong to.
+struct FrameTiming
+{
+    uint64_t FrameNumber;               // as returned by renderScene
+    int MeshID;
+    VertexPullingMode Mode;
+    int SoftVertexCacheLockStrategy;    // lock strategy that was used for the frame
+    uint64_t ComputeNanoseconds;        // 0 if the frame had no compute passes
+    uint64_t DepthPrepassNanoseconds;   // 0 if the frame had no depth prepass
+    uint64_t DrawNanoseconds;
+    uint64_t ElapsedNanoseconds;        // sum of the above
+    bool HasPipelineStatistics;         // false if they were disabled for the frame
+    PipelineStatistics Statistics;
+};
+
+// Size of one of the buffers of a mesh
+struct BufferFootprint
+{
+    std::string Name;
+    uint64_t Bytes;
+};
+
+// Memory used and traffic generated by a mode for a mesh, estimated from the layout of the buffers it reads and writes.
+// Every element is assumed to be fetched from memory each time it is used, including the padding of the XYZW layouts,
+// so BytesPerFrame is an upper bound of the traffic that ignores the post-transform cache and the memory caches.
+struct ModeMemoryFootprint
+{
+    uint64_t ResidentBytes;         // size of the mesh buffers the mode uses, including the scratch buffers of its compute passes
+    uint64_t BytesPerFrame;         // bytes read and written per frame by the compute passes, the depth prepass and the draw
+    uint64_t VerticesPerFrame;      // triangle corners of the mesh, whatever the mode processes them as
+    double BytesPerVertex;          // BytesPerFrame / VerticesPerFrame
+};
+
+inline bool IsSoftVertexCacheMode(int mode)
+{
+    return mode == PULLER_OBJ_SOFTCACHE_MODE || mode == PULLER_SSBO_SOFTCACHE_MODE;
+}
+
+// Modes that can render a depth-only pass that reads positions only before the main pass.
+// They cover the AoS XYZW, SoA and interleaved vertex arrays, and the AoS XYZW, SoA and OBJ-style storage buffers.
+inline bool IsDepthPrepassMode(int mode)
+{
+    return mode == FIXED_FUNCTION_AOS_XYZW_MODE || mode == FIXED_FUNCTION_SOA_MODE || mode == FIXED_FUNCTION_INTERLEAVED_MODE ||
+           mode == PULLER_SSBO_AOS_1FETCH_MODE || mode == PULLER_SSBO_SOA_MODE || mode == PULLER_OBJ_MODE;
+}
+
+enum SoftVertexCacheEncoding
+{
+    // view-space position, view-space normal and clip position as three vec4s (48 bytes)
+    SOFT_VERTEX_CACHE_ENCODING_FULL,
+    // clip position as 4xfp32 and normal as 3xfp32, view-space position is reconstructed from clip space (28 bytes)
+    SOFT_VERTEX_CACHE_ENCODING_CLIP_POSITION,
+    // clip position as 4xfp32 and normal as octahedral 2x16 snorm (20 bytes)
+    SOFT_VERTEX_CACHE_ENCODING_CLIP_POSITION_OCTAHEDRAL_NORMAL,
+    NUMBER_OF_SOFT_VERTEX_CACHE_ENCODINGS
+};
+
+enum SoftVertexCacheLockStrategy
+{
+    // shared readers-writer lock, retried up to NumReadCacheLockAttempts/NumWriteCacheLockAttempts times
+    SOFT_VERTEX_CACHE_LOCK_READERS_WRITER,
+    // shared readers-writer lock, giving up after the first failed attempt
+    SOFT_VERTEX_CACHE_LOCK_TRY_ONCE,
+    // exclusive ticket lock for both reads and writes, a ticket is only taken when it is served right away
+    SOFT_VERTEX_CACHE_LOCK_TICKET,
+    // shared readers-writer lock with exponential backoff between attempts
+    SOFT_VERTEX_CACHE_LOCK_EXPONENTIAL_BACKOFF,
+    // seqlock: readers validate a sequence number instead of taking the lock
+    SOFT_VERTEX_CACHE_LOCK_SEQLOCK,
+    // only writers lock, entries are published atomically and validated by the readers
+    SOFT_VERTEX_CACHE_LOCK_WRITER_ONLY,
+    NUMBER_OF_SOFT_VERTEX_CACHE_LOCK_STRATEGIES
+};
+
 struct SoftVertexCacheConfig
 {
     int NumCacheBucketBits;
@@ -70,6 +189,18 @@ struct SoftVertexCacheConfig
     int NumCacheEntriesPerBucket;
     int MaxSimultaneousReaders;
     bool EnableCacheMissCounter;
+    SoftVertexCacheEncoding VertexEncoding;
+    SoftVertexCacheLockStrategy LockStrategy;
+    bool EnableCacheInstrumentation;
+};
+
+struct SoftVertexCacheInstrumentation
+{
+    int ReadLockFailures;               // lookups that gave up on acquiring read access
+    int WriteLockFailures;              // inserts that gave up on acquiring write access
+    int Evictions;                      // inserts that pushed a valid entry out of its bucket
+    std::vector<int> WayHits;           // hits per FIFO way, most recently inserted first
+    std::vector<int> BucketAccesses;    // lookups per bucket
 };
 
 class IBuddhaDemo
@@ -79,13 +210,63 @@ public:
 
     virtual int addMesh(const char* path) = 0;
 
-    virtual void renderScene(int meshID, const glm::mat4& modelMatrix, int screenWidth, int screenHeight, float dtsec, VertexPullingMode mode, uint64_t* elapsedNanoseconds) = 0;
+    // Returns the frame number the timing of this frame will be tagged with (see PollFrameTiming.)
+    virtual void renderScene(int meshID, const glm::mat4& modelMatrix, int screenWidth, int screenHeight, float dtsec, VertexPullingMode mode, uint64_t* pFrameNumber) = 0;
+
+    // Returns the timing of the oldest frame whose GPU times became available, or false if there is none.
+    // Doesn't wait for the GPU. Call it until it returns false to get all of them.
+    virtual bool PollFrameTiming(FrameTiming* pTiming) = 0;
 
     virtual std::string GetModeName(int mode) = 0;
 
     virtual SoftVertexCacheConfig GetSoftVertexCacheConfig() const = 0;
     virtual void SetSoftVertexCacheConfig(const SoftVertexCacheConfig& config) = 0;
     virtual void GetSoftVertexCacheStats(int* pNumCacheMisses, int* pTotalNumVerts) const = 0;
+
+    // Returns the most recent instrumentation data that was read back from the GPU, if any.
+    virtual bool GetSoftVertexCacheInstrumentation(SoftVertexCacheInstrumentation* pInstrumentation) const = 0;
+
+    // Scale of the resolution the scene is rendered at, relative to the screen. The result is scaled to the screen.
+    virtual float GetRenderScale() const = 0;
+    virtual void SetRenderScale(float scale) = 0;
+
+    // Enables a depth-only pass that reads positions only before the main pass, which then uses GL_EQUAL depth testing.
+    // Only affects the modes for which IsDepthPrepassMode is true.
+    virtual bool GetDepthPrepass() const = 0;
+    virtual void SetDepthPrepass(bool enabled) = 0;
+
+    // Enables pipeline statistics queries around the main draw, which are returned with the frame's timing.
+    // They can only be enabled if ARB_pipeline_statistics_query is supported.
+    virtual bool IsPipelineStatisticsSupported() const = 0;
+    virtual bool GetPipelineStatistics() const = 0;
+    virtual void SetPipelineStatistics(bool enabled) = 0;
+
+    // Renders the mesh offscreen with both modes from the same viewpoint and compares the results.
+    // Channels that differ by at most channelTolerance (in 8-bit units) are considered equal, to allow for rounding differences.
+    virtual void CompareModes(int meshID, const glm::mat4& modelMatrix, int screenWidth, int screenHeight, VertexPullingMode mode, VertexPullingMode referenceMode, int channelTolerance, ModeComparisonResult* pResult) = 0;
+
+    // Marks the GPU-deduplicated version of a mesh as stale, so it gets rebuilt the next time it is drawn.
+    virtual void InvalidateDeduplicatedMesh(int meshID) = 0;
+    // Returns the number of vertices of the GPU-deduplicated version of a mesh, or -1 if it hasn't been built yet.
+    // The count is read back asynchronously, so it arrives a few frames after the mesh is built.
+    virtual int GetNumDeduplicatedVertices(int meshID) const = 0;
+
+    // Returns the size of every buffer of a mesh.
+    virtual void GetMeshMemoryFootprint(int meshID, std::vector<BufferFootprint>* pBuffers) const = 0;
+    // Returns the memory footprint of a mode for a mesh, with the current soft cache config and depth prepass setting.
+    virtual ModeMemoryFootprint GetModeMemoryFootprint(int meshID, int mode) const = 0;
+
+    // Returns the extension used by the subgroup modes, or NULL if they fell back to the plain puller shaders.
+    virtual const char* GetSubgroupExtensionName() const = 0;
+
+    // Profiler that renderScene records its zones in. The caller begins and ends the frames.
+    virtual Profiler* GetProfiler() = 0;
+
+    // Returns true if renderScene sends its bindings with the multi-bind functions of GL 4.4 rather than one slot at a time.
+    virtual bool IsUsingMultiBind() const = 0;
+
+    // Returns the passes of the last renderScene call in order, with the memory barrier issued before each of them.
+    virtual void GetLastSceneMemoryBarriers(std::vector<PassMemoryBarrier>* pBarriers) const = 0;
 };
 
 } /* namespace buddha */
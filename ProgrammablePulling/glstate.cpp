@@ -0,0 +1,265 @@
+/*
+ * glstate.cpp
+ *
+ *  Cache of the GL bindings and enables set by the demo, to skip the redundant ones
+ */
+
+#include "glstate.h"
+
+#include <algorithm>
+#include <cassert>
+#include <initializer_list>
+
+namespace buddha {
+
+// never generated by GL, so the state is sent the next time it's set
+static const GLuint kUnknownName = 0xFFFFFFFF;
+
+// format of the image units that are unbound, any valid format works
+static const GLenum kUnboundImageFormat = GL_R8;
+
+// every target the demo binds textures to through the cache
+static const GLenum kTextureTargets[] = { GL_TEXTURE_BUFFER, GL_TEXTURE_2D };
+
+bool GLStateCache::BindingSlots::GetDirtyRange(int* pFirst, int* pLast) const
+{
+    int first = 0;
+    while (first < kNumBindingSlots && !IsDirty(first))
+    {
+        first++;
+    }
+
+    if (first == kNumBindingSlots)
+    {
+        return false;
+    }
+
+    int last = kNumBindingSlots;
+    while (!IsDirty(last - 1))
+    {
+        last--;
+    }
+
+    *pFirst = first;
+    *pLast = last;
+    return true;
+}
+
+void GLStateCache::BindingSlots::MarkClean(int first, int last)
+{
+    std::copy(Staged + first, Staged + last, Bound + first);
+    std::copy(StagedFormats + first, StagedFormats + last, BoundFormats + first);
+}
+
+GLStateCache::GLStateCache()
+    : mUseMultiBind(false)
+{
+    Invalidate();
+    ResetBindings();
+}
+
+void GLStateCache::Init()
+{
+    mUseMultiBind = GLEW_VERSION_4_4 || GLEW_ARB_multi_bind;
+
+    Invalidate();
+    ResetBindings();
+}
+
+void GLStateCache::Invalidate()
+{
+    for (BindingSlots* pSlots : { &mTextures, &mImageTextures, &mStorageBuffers })
+    {
+        std::fill(pSlots->Bound, pSlots->Bound + kNumBindingSlots, kUnknownName);
+        std::fill(pSlots->BoundFormats, pSlots->BoundFormats + kNumBindingSlots, GL_NONE);
+    }
+
+    for (BufferRange& range : mUniformBuffers)
+    {
+        range.Buffer = kUnknownName;
+    }
+    mProgramPipeline = kUnknownName;
+    mProgram = kUnknownName;
+    mVertexArray = kUnknownName;
+    std::fill(mEnabled, mEnabled + NUMBER_OF_CAPABILITIES, -1);
+}
+
+void GLStateCache::ResetBindings()
+{
+    for (BindingSlots* pSlots : { &mTextures, &mImageTextures, &mStorageBuffers })
+    {
+        std::fill(pSlots->Staged, pSlots->Staged + kNumBindingSlots, 0);
+        std::fill(pSlots->StagedFormats, pSlots->StagedFormats + kNumBindingSlots, GL_NONE);
+    }
+
+    std::fill(mImageTextures.StagedFormats, mImageTextures.StagedFormats + kNumBindingSlots, kUnboundImageFormat);
+}
+
+void GLStateCache::SetTexture(int unit, GLenum target, GLuint texture)
+{
+    assert(unit >= 0 && unit < kNumBindingSlots);
+    mTextures.Staged[unit] = texture;
+    mTextures.StagedFormats[unit] = texture ? target : GL_NONE;
+}
+
+void GLStateCache::SetImageTexture(int unit, GLuint texture, GLenum format)
+{
+    assert(unit >= 0 && unit < kNumBindingSlots);
+    mImageTextures.Staged[unit] = texture;
+    mImageTextures.StagedFormats[unit] = format;
+}
+
+void GLStateCache::SetStorageBuffer(int index, GLuint buffer)
+{
+    assert(index >= 0 && index < kNumBindingSlots);
+    mStorageBuffers.Staged[index] = buffer;
+}
+
+void GLStateCache::CommitBindings()
+{
+    int first, last;
+
+    // the clean slots in the middle of a range are bound again, which is still cheaper than splitting the call
+    if (mTextures.GetDirtyRange(&first, &last))
+    {
+        if (mUseMultiBind)
+        {
+            glBindTextures(first, last - first, &mTextures.Staged[first]);
+        }
+        else
+        {
+            for (int unit = first; unit < last; unit++)
+            {
+                if (!mTextures.IsDirty(unit))
+                {
+                    continue;
+                }
+
+                // like glBindTextures, a texture only replaces the one bound to its own target, and unbinding clears them all
+                glActiveTexture(GL_TEXTURE0 + unit);
+                if (mTextures.Staged[unit] != 0)
+                {
+                    glBindTexture(mTextures.StagedFormats[unit], mTextures.Staged[unit]);
+                }
+                else if (mTextures.Bound[unit] != kUnknownName)
+                {
+                    glBindTexture(mTextures.BoundFormats[unit], 0);
+                }
+                else
+                {
+                    for (GLenum target : kTextureTargets)
+                    {
+                        glBindTexture(target, 0);
+                    }
+                }
+            }
+        }
+        mTextures.MarkClean(first, last);
+    }
+
+    if (mImageTextures.GetDirtyRange(&first, &last))
+    {
+        if (mUseMultiBind)
+        {
+            // bound read-write with the format of the texture, the shaders only read them
+            glBindImageTextures(first, last - first, &mImageTextures.Staged[first]);
+        }
+        else
+        {
+            for (int unit = first; unit < last; unit++)
+            {
+                if (mImageTextures.IsDirty(unit))
+                {
+                    glBindImageTexture(unit, mImageTextures.Staged[unit], 0, GL_FALSE, 0, GL_READ_ONLY, mImageTextures.StagedFormats[unit]);
+                }
+            }
+        }
+        mImageTextures.MarkClean(first, last);
+    }
+
+    if (mStorageBuffers.GetDirtyRange(&first, &last))
+    {
+        if (mUseMultiBind)
+        {
+            glBindBuffersBase(GL_SHADER_STORAGE_BUFFER, first, last - first, &mStorageBuffers.Staged[first]);
+        }
+        else
+        {
+            for (int index = first; index < last; index++)
+            {
+                if (mStorageBuffers.IsDirty(index))
+                {
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, mStorageBuffers.Staged[index]);
+                }
+            }
+        }
+        mStorageBuffers.MarkClean(first, last);
+    }
+}
+
+void GLStateCache::BindUniformBufferRange(int index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    assert(index >= 0 && index < kNumBindingSlots);
+    BufferRange& range = mUniformBuffers[index];
+    if (range.Buffer != buffer || range.Offset != offset || range.Size != size)
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+        range.Buffer = buffer;
+        range.Offset = offset;
+        range.Size = size;
+    }
+}
+
+void GLStateCache::BindProgramPipeline(GLuint pipeline)
+{
+    if (mProgramPipeline != pipeline)
+    {
+        glBindProgramPipeline(pipeline);
+        mProgramPipeline = pipeline;
+    }
+}
+
+void GLStateCache::UseProgram(GLuint program)
+{
+    // the pipeline is only used when no program is current, but its binding is kept
+    if (mProgram != program)
+    {
+        glUseProgram(program);
+        mProgram = program;
+    }
+}
+
+void GLStateCache::BindVertexArray(GLuint vertexArray)
+{
+    if (mVertexArray != vertexArray)
+    {
+        glBindVertexArray(vertexArray);
+        mVertexArray = vertexArray;
+    }
+}
+
+void GLStateCache::SetEnabled(GLenum capability, bool enabled)
+{
+    int index;
+    switch (capability)
+    {
+    case GL_DEPTH_TEST: index = CAPABILITY_DEPTH_TEST; break;
+    case GL_FRAMEBUFFER_SRGB: index = CAPABILITY_FRAMEBUFFER_SRGB; break;
+    default: assert(!"capability isn't tracked"); return;
+    }
+
+    if (mEnabled[index] != int(enabled))
+    {
+        if (enabled)
+        {
+            glEnable(capability);
+        }
+        else
+        {
+            glDisable(capability);
+        }
+        mEnabled[index] = int(enabled);
+    }
+}
+
+} /* namespace buddha */
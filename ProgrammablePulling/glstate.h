@@ -0,0 +1,100 @@
+/*
+ * glstate.h
+ *
+ *  Cache of the GL bindings and enables set by the demo, to skip the redundant ones
+ */
+
+#ifndef GLSTATE_H_
+#define GLSTATE_H_
+
+#include <GL/glew.h>
+
+namespace buddha {
+
+// Remembers the state last sent to GL, and only sends the state that differs from it.
+// The cache assumes it is the only code changing the state it tracks. Whoever changes that state behind its back,
+// or deletes objects that may be bound (the names can be reused), must call Invalidate.
+class GLStateCache
+{
+public:
+    // texture units, image units and storage buffer bindings that are tracked
+    static const int kNumBindingSlots = 16;
+
+    GLStateCache();
+
+    GLStateCache(const GLStateCache&) = delete;
+    GLStateCache& operator=(const GLStateCache&) = delete;
+
+    // Call after glewInit. The multi-bind functions of GL 4.4 are used when they're supported.
+    void Init();
+    bool IsUsingMultiBind() const { return mUseMultiBind; }
+
+    // Forgets the state, so everything is sent again the next time it's set.
+    void Invalidate();
+
+    // The resources of a draw or dispatch are staged, then committed together right before it.
+    // ResetBindings unstages everything: the slots that aren't staged again are unbound by the next commit,
+    // so a resource of a previous pass doesn't stay bound while it's used in another way.
+    // The slots that changed are sent as one range per kind of binding when multi-bind is supported.
+    void ResetBindings();
+    void SetTexture(int unit, GLenum target, GLuint texture);
+    void SetTextureBuffer(int unit, GLuint texture) { SetTexture(unit, GL_TEXTURE_BUFFER, texture); }
+    void SetImageTexture(int unit, GLuint texture, GLenum format);     // read-only, format must match the texture's with multi-bind
+    void SetStorageBuffer(int index, GLuint buffer);
+    void CommitBindings();
+
+    // The rest of the state is sent right away if it changed.
+    void BindUniformBufferRange(int index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    void BindProgramPipeline(GLuint pipeline);
+    void UseProgram(GLuint program);
+    void BindVertexArray(GLuint vertexArray);
+    void SetEnabled(GLenum capability, bool enabled);       // GL_DEPTH_TEST or GL_FRAMEBUFFER_SRGB
+
+private:
+    enum Capability
+    {
+        CAPABILITY_DEPTH_TEST,
+        CAPABILITY_FRAMEBUFFER_SRGB,
+        NUMBER_OF_CAPABILITIES
+    };
+
+    struct BindingSlots
+    {
+        GLuint Bound[kNumBindingSlots];
+        GLuint Staged[kNumBindingSlots];
+        GLenum BoundFormats[kNumBindingSlots];      // format of the image units, target of the textures (GL_NONE if unbound)
+        GLenum StagedFormats[kNumBindingSlots];
+
+        bool IsDirty(int slot) const
+        {
+            return Bound[slot] != Staged[slot] || BoundFormats[slot] != StagedFormats[slot];
+        }
+
+        // first and one past the last slot that changed, returns false if none did
+        bool GetDirtyRange(int* pFirst, int* pLast) const;
+        void MarkClean(int first, int last);
+    };
+
+    bool mUseMultiBind;
+
+    BindingSlots mTextures;
+    BindingSlots mImageTextures;
+    BindingSlots mStorageBuffers;
+
+    struct BufferRange
+    {
+        GLuint Buffer;
+        GLintptr Offset;
+        GLsizeiptr Size;
+    };
+
+    BufferRange mUniformBuffers[kNumBindingSlots];
+    GLuint mProgramPipeline;
+    GLuint mProgram;
+    GLuint mVertexArray;
+    int mEnabled[NUMBER_OF_CAPABILITIES];       // 0 or 1, -1 if unknown
+};
+
+} /* namespace buddha */
+
+#endif /* GLSTATE_H_ */
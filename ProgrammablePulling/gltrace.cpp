@@ -0,0 +1,353 @@
+/*
+ * gltrace.cpp
+ *
+ *  Interception of the GLEW entry points, to count and time the GL calls of every frame
+ */
+
+#include "gltrace.h"
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+
+namespace buddha {
+
+// A GL call is a bind if the state it sets is identified by its first few arguments, and set to the value of the others.
+// A bind is redundant when the previous bind of the same state had the same value.
+// Deleting an object resets the binds, since the driver unbinds it and its name can be reused.
+// The multi-bind functions also reset them, rather than tracking every slot of the range they bind.
+// Binding another vertex array resets the element array buffer bind, which is part of the vertex array state.
+#define GL_CALL_NOT_A_BIND -1
+#define GL_CALL_RESETS_BINDS -2
+
+// name and either the number of arguments that identify the state it binds, or GL_CALL_NOT_A_BIND or GL_CALL_RESETS_BINDS
+#define GL_TRACED_FUNCTIONS(X) \
+    X(ActiveTexture, 0) \
+    X(AttachShader, GL_CALL_NOT_A_BIND) \
+    X(BeginQuery, GL_CALL_NOT_A_BIND) \
+    X(BeginTransformFeedback, GL_CALL_NOT_A_BIND) \
+    X(BindBuffer, 1) \
+    X(BindBufferBase, 2) \
+    X(BindBufferRange, 2) \
+    X(BindBuffersBase, GL_CALL_RESETS_BINDS) \
+    X(BindFramebuffer, 1) \
+    X(BindImageTexture, 1) \
+    X(BindImageTextures, GL_CALL_RESETS_BINDS) \
+    X(BindProgramPipeline, 0) \
+    X(BindTextures, GL_CALL_RESETS_BINDS) \
+    X(BindVertexArray, 0) \
+    X(BlendEquation, GL_CALL_NOT_A_BIND) \
+    X(BlendEquationSeparate, GL_CALL_NOT_A_BIND) \
+    X(BlitFramebuffer, GL_CALL_NOT_A_BIND) \
+    X(BufferData, GL_CALL_NOT_A_BIND) \
+    X(BufferStorage, GL_CALL_NOT_A_BIND) \
+    X(BufferSubData, GL_CALL_NOT_A_BIND) \
+    X(CheckFramebufferStatus, GL_CALL_NOT_A_BIND) \
+    X(ClearBufferData, GL_CALL_NOT_A_BIND) \
+    X(ClearBufferfv, GL_CALL_NOT_A_BIND) \
+    X(ClearBufferuiv, GL_CALL_NOT_A_BIND) \
+    X(ClientWaitSync, GL_CALL_NOT_A_BIND) \
+    X(CompileShader, GL_CALL_NOT_A_BIND) \
+    X(CopyBufferSubData, GL_CALL_NOT_A_BIND) \
+    X(CreateProgram, GL_CALL_NOT_A_BIND) \
+    X(CreateShader, GL_CALL_NOT_A_BIND) \
+    X(CreateShaderProgramv, GL_CALL_NOT_A_BIND) \
+    X(DeleteBuffers, GL_CALL_RESETS_BINDS) \
+    X(DeleteFramebuffers, GL_CALL_RESETS_BINDS) \
+    X(DeleteProgram, GL_CALL_RESETS_BINDS) \
+    X(DeleteProgramPipelines, GL_CALL_RESETS_BINDS) \
+    X(DeleteShader, GL_CALL_NOT_A_BIND) \
+    X(DeleteSync, GL_CALL_NOT_A_BIND) \
+    X(DeleteVertexArrays, GL_CALL_RESETS_BINDS) \
+    X(DetachShader, GL_CALL_NOT_A_BIND) \
+    X(DispatchCompute, GL_CALL_NOT_A_BIND) \
+    X(DrawArraysInstancedBaseInstance, GL_CALL_NOT_A_BIND) \
+    X(DrawElementsInstancedBaseVertexBaseInstance, GL_CALL_NOT_A_BIND) \
+    X(EnableVertexAttribArray, GL_CALL_NOT_A_BIND) \
+    X(EndQuery, GL_CALL_NOT_A_BIND) \
+    X(EndTransformFeedback, GL_CALL_NOT_A_BIND) \
+    X(FenceSync, GL_CALL_NOT_A_BIND) \
+    X(FramebufferTexture2D, GL_CALL_NOT_A_BIND) \
+    X(GenBuffers, GL_CALL_NOT_A_BIND) \
+    X(GenFramebuffers, GL_CALL_NOT_A_BIND) \
+    X(GenProgramPipelines, GL_CALL_NOT_A_BIND) \
+    X(GenQueries, GL_CALL_NOT_A_BIND) \
+    X(GenVertexArrays, GL_CALL_NOT_A_BIND) \
+    X(GetAttribLocation, GL_CALL_NOT_A_BIND) \
+    X(GetInteger64v, GL_CALL_NOT_A_BIND) \
+    X(GetProgramInfoLog, GL_CALL_NOT_A_BIND) \
+    X(GetProgramPipelineInfoLog, GL_CALL_NOT_A_BIND) \
+    X(GetProgramPipelineiv, GL_CALL_NOT_A_BIND) \
+    X(GetProgramiv, GL_CALL_NOT_A_BIND) \
+    X(GetQueryObjectui64v, GL_CALL_NOT_A_BIND) \
+    X(GetQueryObjectuiv, GL_CALL_NOT_A_BIND) \
+    X(GetStringi, GL_CALL_NOT_A_BIND) \
+    X(GetUniformLocation, GL_CALL_NOT_A_BIND) \
+    X(LinkProgram, GL_CALL_NOT_A_BIND) \
+    X(MapBufferRange, GL_CALL_NOT_A_BIND) \
+    X(MemoryBarrier, GL_CALL_NOT_A_BIND) \
+    X(PatchParameterfv, GL_CALL_NOT_A_BIND) \
+    X(PatchParameteri, GL_CALL_NOT_A_BIND) \
+    X(QueryCounter, GL_CALL_NOT_A_BIND) \
+    X(ShaderSource, GL_CALL_NOT_A_BIND) \
+    X(TexBuffer, GL_CALL_NOT_A_BIND) \
+    X(TexStorage2D, GL_CALL_NOT_A_BIND) \
+    X(TransformFeedbackVaryings, GL_CALL_NOT_A_BIND) \
+    X(Uniform1i, GL_CALL_NOT_A_BIND) \
+    X(UniformMatrix4fv, GL_CALL_NOT_A_BIND) \
+    X(UnmapBuffer, GL_CALL_NOT_A_BIND) \
+    X(UseProgram, 0) \
+    X(UseProgramStages, GL_CALL_NOT_A_BIND) \
+    X(ValidateProgramPipeline, GL_CALL_NOT_A_BIND) \
+    X(VertexAttribPointer, GL_CALL_NOT_A_BIND)
+
+enum GLTracedFunction
+{
+#define X(name, bindKind) GL_TRACED_##name,
+    GL_TRACED_FUNCTIONS(X)
+#undef X
+    NUMBER_OF_GL_TRACED_FUNCTIONS
+};
+
+static const char* const kGLTracedFunctionNames[NUMBER_OF_GL_TRACED_FUNCTIONS] = {
+#define X(name, bindKind) "gl" #name,
+    GL_TRACED_FUNCTIONS(X)
+#undef X
+};
+
+static const int kGLTracedFunctionBindKinds[NUMBER_OF_GL_TRACED_FUNCTIONS] = {
+#define X(name, bindKind) bindKind,
+    GL_TRACED_FUNCTIONS(X)
+#undef X
+};
+
+// function pointers loaded by GLEW, as they were before the hooks were installed
+static void* sOriginalFunctions[NUMBER_OF_GL_TRACED_FUNCTIONS];
+static bool sIsInstalled;
+
+struct GLCallCounters
+{
+    uint64_t NumCalls;
+    uint64_t NumRedundantCalls;
+    std::chrono::steady_clock::duration CPUTime;
+};
+
+static GLCallCounters sCounters[NUMBER_OF_GL_TRACED_FUNCTIONS];
+static std::vector<GLCallStatistics> sLastFrameStatistics;
+
+// last value of each bound state, keyed by a hash of the function and the arguments that identify the state
+static std::unordered_map<uint64_t, uint64_t> sBoundValues;
+
+static uint64_t hashCombine(uint64_t hash, uint64_t value)
+{
+    // FNV-1a style mixing, collisions are unlikely enough for statistics
+    return (hash ^ value) * 1099511628211ull;
+}
+
+template<class T>
+static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, uint64_t>::type toUInt64(T value)
+{
+    return uint64_t(value);
+}
+
+template<class T>
+static uint64_t toUInt64(T* value)
+{
+    return uint64_t(uintptr_t(value));
+}
+
+static uint64_t toUInt64(GLfloat value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static uint64_t toUInt64(GLdouble value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static uint64_t getBindKey(int function, const uint64_t* keyArguments)
+{
+    uint64_t key = hashCombine(14695981039346656037ull, uint64_t(function));
+    for (int i = 0; i < kGLTracedFunctionBindKinds[function]; i++)
+    {
+        key = hashCombine(key, keyArguments[i]);
+    }
+    return key;
+}
+
+static bool isRedundantBind(int function, const uint64_t* arguments, int numArguments)
+{
+    int numKeyArguments = kGLTracedFunctionBindKinds[function];
+    uint64_t key = getBindKey(function, arguments);
+
+    uint64_t value = 14695981039346656037ull;
+    for (int i = numKeyArguments; i < numArguments; i++)
+    {
+        value = hashCombine(value, arguments[i]);
+    }
+
+    std::unordered_map<uint64_t, uint64_t>::iterator found = sBoundValues.find(key);
+    if (found != sBoundValues.end() && found->second == value)
+    {
+        return true;
+    }
+
+    sBoundValues[key] = value;
+    return false;
+}
+
+// adds the time spent in the original function when it goes out of scope, so it works whatever the function returns
+class GLCallTimer
+{
+public:
+    explicit GLCallTimer(int function)
+        : mFunction(function)
+        , mBeginTime(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~GLCallTimer()
+    {
+        sCounters[mFunction].CPUTime += std::chrono::steady_clock::now() - mBeginTime;
+    }
+
+private:
+    int mFunction;
+    std::chrono::steady_clock::time_point mBeginTime;
+};
+
+template<class Function>
+struct GLCallHook;
+
+template<class R, class... Args>
+struct GLCallHook<R (GLAPIENTRY*)(Args...)>
+{
+    template<int function>
+    static R GLAPIENTRY Call(Args... args)
+    {
+        GLCallCounters& counters = sCounters[function];
+        counters.NumCalls++;
+
+        int bindKind = kGLTracedFunctionBindKinds[function];
+        if (bindKind == GL_CALL_RESETS_BINDS)
+        {
+            sBoundValues.clear();
+        }
+        else if (bindKind != GL_CALL_NOT_A_BIND)
+        {
+            // the extra element avoids a zero-sized array for the functions without arguments
+            const uint64_t arguments[sizeof...(Args) + 1] = { toUInt64(args)..., 0 };
+            if (isRedundantBind(function, arguments, int(sizeof...(Args))))
+            {
+                counters.NumRedundantCalls++;
+            }
+            else if (function == GL_TRACED_BindVertexArray)
+            {
+                // the element array buffer binding is part of the vertex array
+                const uint64_t elementArrayBufferTarget = GL_ELEMENT_ARRAY_BUFFER;
+                sBoundValues.erase(getBindKey(GL_TRACED_BindBuffer, &elementArrayBufferTarget));
+            }
+        }
+
+        GLCallTimer timer(function);
+        return ((R (GLAPIENTRY*)(Args...))sOriginalFunctions[function])(args...);
+    }
+};
+
+namespace GLCallTracer {
+
+void Install()
+{
+    if (sIsInstalled)
+    {
+        return;
+    }
+
+    // functions that the driver doesn't support are left alone, they're not called anyway
+#define X(name, bindKind) \
+    sOriginalFunctions[GL_TRACED_##name] = (void*)__glew##name; \
+    if (__glew##name) \
+    { \
+        __glew##name = &GLCallHook<decltype(__glew##name)>::Call<GL_TRACED_##name>; \
+    }
+    GL_TRACED_FUNCTIONS(X)
+#undef X
+
+    // the state may have changed while the hooks weren't installed
+    sBoundValues.clear();
+    std::fill(sCounters, sCounters + NUMBER_OF_GL_TRACED_FUNCTIONS, GLCallCounters());
+    sLastFrameStatistics.clear();
+
+    sIsInstalled = true;
+}
+
+void Uninstall()
+{
+    if (!sIsInstalled)
+    {
+        return;
+    }
+
+#define X(name, bindKind) \
+    __glew##name = (decltype(__glew##name))sOriginalFunctions[GL_TRACED_##name];
+    GL_TRACED_FUNCTIONS(X)
+#undef X
+
+    sLastFrameStatistics.clear();
+
+    sIsInstalled = false;
+}
+
+bool IsInstalled()
+{
+    return sIsInstalled;
+}
+
+void EndFrame()
+{
+    if (!sIsInstalled)
+    {
+        return;
+    }
+
+    sLastFrameStatistics.clear();
+    for (int i = 0; i < NUMBER_OF_GL_TRACED_FUNCTIONS; i++)
+    {
+        if (sCounters[i].NumCalls == 0)
+        {
+            continue;
+        }
+
+        GLCallStatistics statistics;
+        statistics.Name = kGLTracedFunctionNames[i];
+        statistics.NumCalls = sCounters[i].NumCalls;
+        statistics.NumRedundantCalls = sCounters[i].NumRedundantCalls;
+        statistics.CPUMilliseconds = std::chrono::duration<double, std::milli>(sCounters[i].CPUTime).count();
+        sLastFrameStatistics.push_back(statistics);
+    }
+
+    std::sort(sLastFrameStatistics.begin(), sLastFrameStatistics.end(), [](const GLCallStatistics& a, const GLCallStatistics& b)
+    {
+        return a.CPUMilliseconds > b.CPUMilliseconds;
+    });
+
+    std::fill(sCounters, sCounters + NUMBER_OF_GL_TRACED_FUNCTIONS, GLCallCounters());
+}
+
+const std::vector<GLCallStatistics>& GetLastFrameStatistics()
+{
+    return sLastFrameStatistics;
+}
+
+} /* namespace GLCallTracer */
+
+} /* namespace buddha */
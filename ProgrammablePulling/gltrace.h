@@ -0,0 +1,45 @@
+/*
+ * gltrace.h
+ *
+ *  Interception of the GLEW entry points, to count and time the GL calls of every frame
+ */
+
+#ifndef GLTRACE_H_
+#define GLTRACE_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace buddha {
+
+struct GLCallStatistics
+{
+    const char* Name;
+    uint64_t NumCalls;
+    uint64_t NumRedundantCalls;     // binds with the same arguments as the previous bind to the same target
+    double CPUMilliseconds;         // time spent in the driver
+};
+
+// Replaces the function pointers loaded by GLEW with hooks that count and time the calls before forwarding them.
+// This covers every GLEW entry point used by the demo and the ImGui binding, but not the GL 1.1 functions
+// (glBindTexture, glClear, glDrawElements...) which are linked directly rather than loaded by GLEW.
+// glDeleteTextures is one of them, so deleting a texture doesn't reset the binds of glBindImageTexture and glBindTextures,
+// and rebinding a new texture that reuses its name can be counted as redundant.
+namespace GLCallTracer {
+
+// Call after glewInit. Uninstall restores the original function pointers.
+void Install();
+void Uninstall();
+bool IsInstalled();
+
+// Ends the current frame: its statistics become the last frame's statistics, and the counters restart from zero.
+void EndFrame();
+
+// Statistics of the functions that were called during the last frame, sorted by decreasing CPU time
+const std::vector<GLCallStatistics>& GetLastFrameStatistics();
+
+} /* namespace GLCallTracer */
+
+} /* namespace buddha */
+
+#endif /* GLTRACE_H_ */
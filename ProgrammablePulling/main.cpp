@@ -9,6 +9,8 @@
 #include <sstream>
 #include <string>
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
 
 #ifdef _WIN32
 #include <d3d12.h>
@@ -22,6 +24,10 @@
 
 #include "wavefront.h"
 #include "buddha.h"
+#include "profiler.h"
+#include "trace.h"
+#include "gltrace.h"
+#include "barrier.h"
 
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_glfw_gl3.h"
@@ -59,6 +65,124 @@ void SetStablePowerState()
 }
 #endif
 
+// Draws the per-bucket access counts as a strip of colored cells, from black (no accesses) to red to yellow (most accessed).
+// Neighboring buckets are merged into one cell when there are more buckets than pixels.
+static void DrawBucketHeatStrip(const std::vector<int>& bucketAccesses, float height)
+{
+    float width = ImGui::GetContentRegionAvailWidth();
+    int numCells = std::min((int)bucketAccesses.size(), std::max(1, (int)width));
+    if (numCells == 0)
+    {
+        return;
+    }
+
+    std::vector<int> cells(numCells, 0);
+    for (size_t i = 0; i < bucketAccesses.size(); i++)
+    {
+        int cell = int(i * numCells / bucketAccesses.size());
+        cells[cell] = std::max(cells[cell], bucketAccesses[i]);
+    }
+
+    int maxAccesses = *std::max_element(cells.begin(), cells.end());
+
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    float cellWidth = width / numCells;
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    for (int i = 0; i < numCells; i++)
+    {
+        float heat = maxAccesses == 0 ? 0.0f : float(cells[i]) / float(maxAccesses);
+        ImColor color(std::min(1.0f, heat * 2.0f), std::max(0.0f, heat * 2.0f - 1.0f), 0.0f, 1.0f);
+        drawList->AddRectFilled(
+            ImVec2(origin.x + cellWidth * i, origin.y),
+            ImVec2(origin.x + cellWidth * (i + 1), origin.y + height),
+            color);
+    }
+
+    ImGui::Dummy(ImVec2(width, height));
+    if (ImGui::IsItemHovered())
+    {
+        int cell = std::min(numCells - 1, std::max(0, int((ImGui::GetMousePos().x - origin.x) / cellWidth)));
+        size_t firstBucket = (cell * bucketAccesses.size() + numCells - 1) / numCells;
+        size_t lastBucket = ((cell + 1) * bucketAccesses.size() + numCells - 1) / numCells - 1;
+        ImGui::SetTooltip("Buckets %zu-%zu: up to %d accesses", firstBucket, lastBucket, cells[cell]);
+    }
+}
+
+// Draws the zones of a frame as nested bars, one row per nesting depth, with a tooltip for the hovered zone.
+// The CPU and GPU timelines use the same scale, so their bars can be compared. Gaps between the bars are unmeasured time.
+static void DrawProfilerTimeline(const buddha::ProfilerFrame& frame, bool gpu)
+{
+    float width = ImGui::GetContentRegionAvailWidth();
+    float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+
+    int maxDepth = 0;
+    for (const buddha::ProfilerZone& zone : frame.Zones)
+    {
+        maxDepth = std::max(maxDepth, zone.Depth);
+    }
+
+    double totalMilliseconds = std::max(frame.CPUMilliseconds, frame.GPUMilliseconds);
+    float pixelsPerMillisecond = totalMilliseconds == 0.0 ? 0.0f : float(width / totalMilliseconds);
+
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    for (size_t i = 0; i < frame.Zones.size(); i++)
+    {
+        const buddha::ProfilerZone& zone = frame.Zones[i];
+        if (gpu && !zone.HasGPUTimes)
+        {
+            continue;
+        }
+
+        double begin = gpu ? zone.GPUBeginMilliseconds : zone.CPUBeginMilliseconds;
+        double end = gpu ? zone.GPUEndMilliseconds : zone.CPUEndMilliseconds;
+
+        ImVec2 topLeft(origin.x + float(begin) * pixelsPerMillisecond, origin.y + zone.Depth * rowHeight);
+        ImVec2 bottomRight(std::max(topLeft.x + 1.0f, origin.x + float(end) * pixelsPerMillisecond), topLeft.y + rowHeight - 1.0f);
+
+        ImColor color = ImColor::HSV(float(i % 8) / 8.0f, 0.6f, 0.7f);
+        drawList->AddRectFilled(topLeft, bottomRight, color);
+
+        ImVec4 clipRect(topLeft.x, topLeft.y, bottomRight.x, bottomRight.y);
+        drawList->AddText(ImGui::GetFont(), ImGui::GetFontSize(), ImVec2(topLeft.x + 2.0f, topLeft.y), ImColor(1.0f, 1.0f, 1.0f), zone.Name, NULL, 0.0f, &clipRect);
+
+        if (ImGui::IsMouseHoveringRect(topLeft, bottomRight))
+        {
+            ImGui::SetTooltip("%s\n%.3f ms (starts at %.3f ms)", zone.Name, end - begin, begin);
+        }
+    }
+
+    ImGui::Dummy(ImVec2(width, (maxDepth + 1) * rowHeight));
+}
+
+static bool IsSameSoftVertexCacheConfig(const buddha::SoftVertexCacheConfig& a, const buddha::SoftVertexCacheConfig& b)
+{
+    return a.NumCacheBucketBits == b.NumCacheBucketBits &&
+           a.NumReadCacheLockAttempts == b.NumReadCacheLockAttempts &&
+           a.NumWriteCacheLockAttempts == b.NumWriteCacheLockAttempts &&
+           a.NumCacheEntriesPerBucket == b.NumCacheEntriesPerBucket &&
+           a.MaxSimultaneousReaders == b.MaxSimultaneousReaders &&
+           a.EnableCacheMissCounter == b.EnableCacheMissCounter &&
+           a.VertexEncoding == b.VertexEncoding &&
+           a.LockStrategy == b.LockStrategy &&
+           a.EnableCacheInstrumentation == b.EnableCacheInstrumentation;
+}
+
+static buddha::TraceWriter::Arguments GetSoftVertexCacheConfigArguments(const buddha::SoftVertexCacheConfig& config)
+{
+    buddha::TraceWriter::Arguments args;
+    args.push_back(std::make_pair("NumCacheBucketBits", std::to_string(config.NumCacheBucketBits)));
+    args.push_back(std::make_pair("NumReadCacheLockAttempts", std::to_string(config.NumReadCacheLockAttempts)));
+    args.push_back(std::make_pair("NumWriteCacheLockAttempts", std::to_string(config.NumWriteCacheLockAttempts)));
+    args.push_back(std::make_pair("NumCacheEntriesPerBucket", std::to_string(config.NumCacheEntriesPerBucket)));
+    args.push_back(std::make_pair("MaxSimultaneousReaders", std::to_string(config.MaxSimultaneousReaders)));
+    args.push_back(std::make_pair("EnableCacheMissCounter", config.EnableCacheMissCounter ? "true" : "false"));
+    args.push_back(std::make_pair("VertexEncoding", std::to_string(config.VertexEncoding)));
+    args.push_back(std::make_pair("LockStrategy", std::to_string(config.LockStrategy)));
+    args.push_back(std::make_pair("EnableCacheInstrumentation", config.EnableCacheInstrumentation ? "true" : "false"));
+    return args;
+}
+
 int main() 
 {
     // Set the GPU to a stable power state, in order to get reliable performance measurements.
@@ -173,8 +297,20 @@ int main()
     modeStringFormats[buddha::PULLER_SSBO_SOA_MODE           ] = "Pull index & vertex |   SoA  | Three R32F SSBO loads   | SSBO      | %8llu microseconds | %s";
     modeStringFormats[buddha::PULLER_OBJ_MODE                ] = "Pull index & vertex |   AoS  | OBJ-style multi-index   | SSBO      | %8llu microseconds | %s";
     modeStringFormats[buddha::PULLER_OBJ_SOFTCACHE_MODE      ] = "Pull w/ soft cache  |   AoS  | OBJ-style + soft cache  | SSBO      | %8llu microseconds | %s";
+    modeStringFormats[buddha::PULLER_SSBO_SOFTCACHE_MODE     ] = "Pull w/ soft cache  |   AoS  | Merged idx + soft cache | SSBO      | %8llu microseconds | %s";
+    modeStringFormats[buddha::PULLER_SSBO_SUBGROUP_MODE      ] = "Pull w/ subgroup    |   AoS  | Merged idx + subgroup   | SSBO      | %8llu microseconds | %s";
+    modeStringFormats[buddha::PULLER_OBJ_SUBGROUP_MODE       ] = "Pull w/ subgroup    |   AoS  | OBJ-style + subgroup    | SSBO      | %8llu microseconds | %s";
+    modeStringFormats[buddha::PULLER_PRETRANSFORMED_MODE     ] = "Pre-transform in CS |   AoS  | Merged idx, pre-xformed | SSBO      | %8llu microseconds | %s";
+    modeStringFormats[buddha::PULLER_OBJ_PRETRANSFORMED_MODE ] = "Pre-transform in CS |   AoS  | OBJ-style, pre-xformed  | SSBO      | %8llu microseconds | %s";
+    modeStringFormats[buddha::FETCHER_DEDUPLICATED_MODE      ] = "Pull vertex         |   AoS  | GPU-merged OBJ corners  | SSBO      | %8llu microseconds | %s";
+    modeStringFormats[buddha::PULLER_BATCH_DEDUP_MODE        ] = "Batch dedup in CS   |   AoS  | 96-index batches        | SSBO      | %8llu microseconds | %s";
     modeStringFormats[buddha::GS_ASSEMBLER_MODE              ] = "Assembly in GS      |   AoS  | OBJ-style + IA in GS    | SSBO      | %8llu microseconds | %s";
     modeStringFormats[buddha::TS_ASSEMBLER_MODE              ] = "Assembly in TS      |   AoS  | OBJ-style + IA in TS    | SSBO      | %8llu microseconds | %s";
+    modeStringFormats[buddha::GS_PULLER_MODE                 ] = "Pull in GS          |   AoS  | OBJ-style, 1 pt per tri | SSBO      | %8llu microseconds | %s";
+    modeStringFormats[buddha::VISIBILITY_BUFFER_MODE         ] = "Visibility buffer   |   AoS  | OBJ-style, pull in FS   | SSBO      | %8llu microseconds | %s";
+    modeStringFormats[buddha::PULLER_CAPTURED_MODE           ] = "Replay XFB capture  |   AoS  | Merged idx, captured    | SSBO      | %8llu microseconds | %s";
+    modeStringFormats[buddha::PULLER_DERIVATIVE_NORMAL_MODE  ] = "Pull idx, no normal |   AoS  | Merged idx, FS normal   | SSBO      | %8llu microseconds | %s";
+    modeStringFormats[buddha::GS_PULLER_FACE_NORMAL_MODE     ] = "Pull in GS, no nrm  |   AoS  | OBJ-style, GS normal    | SSBO      | %8llu microseconds | %s";
 
     for (const char* mode : modeStringFormats)
     {
@@ -202,6 +338,30 @@ int main()
         meshNumTimes.push_back(std::vector<int>(buddha::NUMBER_OF_MODES, 0));
     }
 
+    // pipeline statistics of the last frame of each mode that had them, VerticesSubmitted is 0 if there is none yet
+    std::vector<std::vector<buddha::PipelineStatistics>> meshPipelineStatistics;
+    for (size_t i = 0; i < meshIDs.size(); i++)
+    {
+        meshPipelineStatistics.push_back(std::vector<buddha::PipelineStatistics>(buddha::NUMBER_OF_MODES, buddha::PipelineStatistics()));
+    }
+
+    // average time of each soft cache mode for each lock strategy, so they can be compared on the same mesh
+    std::vector<std::vector<uint64_t>> meshLockStrategyTotalTimes;
+    std::vector<std::vector<int>> meshLockStrategyNumTimes;
+    for (size_t i = 0; i < meshIDs.size(); i++)
+    {
+        meshLockStrategyTotalTimes.push_back(std::vector<uint64_t>(buddha::NUMBER_OF_MODES * buddha::NUMBER_OF_SOFT_VERTEX_CACHE_LOCK_STRATEGIES, 0));
+        meshLockStrategyNumTimes.push_back(std::vector<int>(buddha::NUMBER_OF_MODES * buddha::NUMBER_OF_SOFT_VERTEX_CACHE_LOCK_STRATEGIES, 0));
+    }
+
+    const char* lockStrategyNames[buddha::NUMBER_OF_SOFT_VERTEX_CACHE_LOCK_STRATEGIES] = {};
+    lockStrategyNames[buddha::SOFT_VERTEX_CACHE_LOCK_READERS_WRITER] = "Readers-writer lock";
+    lockStrategyNames[buddha::SOFT_VERTEX_CACHE_LOCK_TRY_ONCE] = "Readers-writer lock, try once";
+    lockStrategyNames[buddha::SOFT_VERTEX_CACHE_LOCK_TICKET] = "Ticket lock";
+    lockStrategyNames[buddha::SOFT_VERTEX_CACHE_LOCK_EXPONENTIAL_BACKOFF] = "Readers-writer lock, exponential backoff";
+    lockStrategyNames[buddha::SOFT_VERTEX_CACHE_LOCK_SEQLOCK] = "Seqlock (optimistic reads)";
+    lockStrategyNames[buddha::SOFT_VERTEX_CACHE_LOCK_WRITER_ONLY] = "Writer-only lock, atomic publish";
+
     static const int kFramesPerBenchmarkMode = 30;
 
     int currBenchmarkMode = 0;
@@ -213,6 +373,32 @@ int main()
 
     int currDemoMode = buddha::FIXED_FUNCTION_AOS_MODE;
 
+    bool cycleLockStrategies = false;
+    int currLockStrategyFrame = 0;
+
+    bool rebuildDeduplicatedMeshEveryFrame = false;
+
+    // result of the last correctness check, for comparisonMode on comparisonMeshIndex
+    int comparisonMode = -1;
+    int comparisonMeshIndex = -1;
+    buddha::ModeComparisonResult comparisonResult = {};
+
+    // the GPU times arrive a few frames late, so the frames rendered before the benchmarks were reset are ignored
+    uint64_t firstBenchmarkedFrameNumber = 0;
+    buddha::FrameTiming lastFrameTiming = {};
+
+    // the profiled frames arrive a few frames late too
+    buddha::ProfilerFrame lastProfilerFrame = {};
+    bool hasProfilerFrame = false;
+
+    // trace of the run, written while it is open. The traced* values are those of the previous frame, to mark changes in the trace.
+    static const char* kTracePath = "trace.json";
+    buddha::TraceWriter traceWriter;
+    double traceStartMilliseconds = 0.0;
+    int tracedMode = -1;
+    int tracedMeshIndex = -1;
+    buddha::SoftVertexCacheConfig tracedCacheConfig = {};
+
     for (;;)
     {
         if (nowBenchmarking)
@@ -231,28 +417,150 @@ int main()
             }
         }
 
+        if (cycleLockStrategies && buddha::IsSoftVertexCacheMode(currDemoMode))
+        {
+            currLockStrategyFrame++;
+            if (currLockStrategyFrame == kFramesPerBenchmarkMode)
+            {
+                currLockStrategyFrame = 0;
+
+                buddha::SoftVertexCacheConfig cacheConfig = pDemo->GetSoftVertexCacheConfig();
+                cacheConfig.LockStrategy = buddha::SoftVertexCacheLockStrategy((cacheConfig.LockStrategy + 1) % buddha::NUMBER_OF_SOFT_VERTEX_CACHE_LOCK_STRATEGIES);
+                pDemo->SetSoftVertexCacheConfig(cacheConfig);
+
+                // the per-mode averages start over with the new strategy, the per-strategy ones keep accumulating
+                for (size_t meshIndex = 0; meshIndex < meshIDs.size(); meshIndex++)
+                {
+                    for (int i = 0; i < buddha::NUMBER_OF_MODES; i++)
+                    {
+                        if (buddha::IsSoftVertexCacheMode(i))
+                        {
+                            meshTotalTimes[meshIndex][i] = 0;
+                            meshNumTimes[meshIndex][i] = 0;
+                        }
+                    }
+                }
+            }
+        }
+
         double now = glfwGetTime();
         double dtsec = now - then;
 
+        buddha::Profiler* pProfiler = pDemo->GetProfiler();
+        pProfiler->BeginFrame();
+
         // fires any pending event callbacks
+        pProfiler->BeginZone("Poll events", false);
         glfwPollEvents();
+        pProfiler->EndZone();
 
         ImGui_ImplGlfwGL3_NewFrame();
         
-        uint64_t elapsedNanoseconds;
+        if (rebuildDeduplicatedMeshEveryFrame && currDemoMode == buddha::FETCHER_DEDUPLICATED_MODE)
+        {
+            pDemo->InvalidateDeduplicatedMesh(meshIDs[currMeshIndex]);
+        }
+
+        // mark the changes whether they come from the GUI or from the benchmark loop
+        if (traceWriter.IsOpen())
+        {
+            double nowMilliseconds = pProfiler->GetCPUMilliseconds();
+            buddha::SoftVertexCacheConfig cacheConfig = pDemo->GetSoftVertexCacheConfig();
+
+            if (currDemoMode != tracedMode)
+            {
+                buddha::TraceWriter::Arguments args;
+                args.push_back(std::make_pair("mode", std::to_string(currDemoMode)));
+                args.push_back(std::make_pair("name", pDemo->GetModeName(currDemoMode)));
+                traceWriter.WriteInstantEvent("Mode switch", nowMilliseconds, args);
+            }
+
+            if (currMeshIndex != tracedMeshIndex)
+            {
+                buddha::TraceWriter::Arguments args;
+                args.push_back(std::make_pair("mesh", meshDisplayNames[currMeshIndex]));
+                traceWriter.WriteInstantEvent("Mesh switch", nowMilliseconds, args);
+            }
+
+            if (tracedMode == -1 || !IsSameSoftVertexCacheConfig(cacheConfig, tracedCacheConfig))
+            {
+                traceWriter.WriteInstantEvent("Soft vertex cache config change", nowMilliseconds, GetSoftVertexCacheConfigArguments(cacheConfig));
+            }
+
+            tracedMode = currDemoMode;
+            tracedMeshIndex = currMeshIndex;
+            tracedCacheConfig = cacheConfig;
+        }
+
+        uint64_t frameNumber;
         pDemo->renderScene(
             meshIDs[currMeshIndex],
             meshMatrices[currMeshIndex],
             screenWidth, screenHeight,
             animate ? (float)dtsec : 0.0f, 
             (buddha::VertexPullingMode)currDemoMode,
-            &elapsedNanoseconds);
+            &frameNumber);
+
+        // attribute each result to the mesh, mode and lock strategy of the frame it was measured on, which may not be the current ones
+        buddha::FrameTiming frameTiming;
+        while (pDemo->PollFrameTiming(&frameTiming))
+        {
+            if (frameTiming.FrameNumber < firstBenchmarkedFrameNumber)
+            {
+                continue;
+            }
+
+            int meshIndex = int(std::find(meshIDs.begin(), meshIDs.end(), frameTiming.MeshID) - meshIDs.begin());
+            int mode = frameTiming.Mode;
+
+            // the per-mode average of a soft cache mode only has the frames of the current lock strategy,
+            // the frames of a previous one can still arrive after it changed
+            bool isSoftVertexCacheMode = buddha::IsSoftVertexCacheMode(mode);
+            if (!isSoftVertexCacheMode || frameTiming.SoftVertexCacheLockStrategy == pDemo->GetSoftVertexCacheConfig().LockStrategy)
+            {
+                meshNumTimes[meshIndex][mode] += 1;
+                meshTotalTimes[meshIndex][mode] += frameTiming.ElapsedNanoseconds;
+            }
+
+            if (isSoftVertexCacheMode)
+            {
+                int lockStrategy = frameTiming.SoftVertexCacheLockStrategy;
+                meshLockStrategyNumTimes[meshIndex][mode * buddha::NUMBER_OF_SOFT_VERTEX_CACHE_LOCK_STRATEGIES + lockStrategy] += 1;
+                meshLockStrategyTotalTimes[meshIndex][mode * buddha::NUMBER_OF_SOFT_VERTEX_CACHE_LOCK_STRATEGIES + lockStrategy] += frameTiming.ElapsedNanoseconds;
+            }
+
+            if (frameTiming.HasPipelineStatistics)
+            {
+                meshPipelineStatistics[meshIndex][mode] = frameTiming.Statistics;
+            }
+
+            lastFrameTiming = frameTiming;
+        }
+
+        buddha::ProfilerFrame profilerFrame;
+        while (pProfiler->PollCompletedFrame(&profilerFrame))
+        {
+            // frames that started before the trace are left out of it
+            if (traceWriter.IsOpen() && profilerFrame.CPUStartMilliseconds >= traceStartMilliseconds)
+            {
+                traceWriter.WriteFrame(profilerFrame);
+            }
+
+            lastProfilerFrame = profilerFrame;
+            hasProfilerFrame = true;
+        }
 
         uint64_t* totalTimes = meshTotalTimes[currMeshIndex].data();
         int* numTimes = meshNumTimes[currMeshIndex].data();
+        buddha::PipelineStatistics* pipelineStatistics = meshPipelineStatistics[currMeshIndex].data();
+
+        uint64_t* allLockStrategyTotalTimes = meshLockStrategyTotalTimes[currMeshIndex].data();
+        int* allLockStrategyNumTimes = meshLockStrategyNumTimes[currMeshIndex].data();
 
-        numTimes[currDemoMode] += 1;
-        totalTimes[currDemoMode] += elapsedNanoseconds;
+        uint64_t* lockStrategyTotalTimes = allLockStrategyTotalTimes + currDemoMode * buddha::NUMBER_OF_SOFT_VERTEX_CACHE_LOCK_STRATEGIES;
+        int* lockStrategyNumTimes = allLockStrategyNumTimes + currDemoMode * buddha::NUMBER_OF_SOFT_VERTEX_CACHE_LOCK_STRATEGIES;
+
+        pProfiler->BeginZone("Build GUI");
 
         ImGui::SetNextWindowSize(ImVec2(900.0f, 700.0f), ImGuiSetCond_Always);
         if (ImGui::Begin("Info", 0, ImGuiWindowFlags_NoResize))
@@ -260,6 +568,9 @@ int main()
             ImGui::Text("Vendor: %s", vendor);
             ImGui::Text("Renderer: %s", renderer);
 
+            const char* subgroupExtensionName = pDemo->GetSubgroupExtensionName();
+            ImGui::Text("Subgroup modes: %s", subgroupExtensionName ? subgroupExtensionName : "not supported (using plain puller shaders)");
+
             char modeStrings[buddha::NUMBER_OF_MODES][1024];
             const char* modeStringPtrs[buddha::NUMBER_OF_MODES];
             for (int i = 0; i < buddha::NUMBER_OF_MODES; i++)
@@ -275,6 +586,29 @@ int main()
                 }
 
                 sprintf(modeStrings[i], modeStringFormats[i], lastTime / 1000, modeName.c_str());
+
+                // bytes per nanosecond are GB/s. the traffic is an upper bound, so this is the bandwidth the mode would need without caches.
+                buddha::ModeMemoryFootprint footprint = pDemo->GetModeMemoryFootprint(meshIDs[currMeshIndex], i);
+                {
+                    size_t length = strlen(modeStrings[i]);
+                    snprintf(modeStrings[i] + length, sizeof(modeStrings[i]) - length, " | %6.1f MB | %5.1f B/vertex",
+                        double(footprint.ResidentBytes) / 1e6, footprint.BytesPerVertex);
+                }
+                if (lastTime != 0)
+                {
+                    size_t length = strlen(modeStrings[i]);
+                    snprintf(modeStrings[i] + length, sizeof(modeStrings[i]) - length, " | %6.1f GB/s | %7.1f Mvertices/s",
+                        double(footprint.BytesPerFrame) / double(lastTime), double(footprint.VerticesPerFrame) * 1e3 / double(lastTime));
+                }
+
+                // fewer vertex shader invocations than vertices means the post-transform cache was used
+                if (pipelineStatistics[i].VerticesSubmitted != 0)
+                {
+                    size_t length = strlen(modeStrings[i]);
+                    snprintf(modeStrings[i] + length, sizeof(modeStrings[i]) - length, " | %.3f VS/vertex",
+                        double(pipelineStatistics[i].VertexShaderInvocations) / double(pipelineStatistics[i].VerticesSubmitted));
+                }
+
                 modeStringPtrs[i] = modeStrings[i];
             }
 
@@ -347,7 +681,57 @@ int main()
 
             ImGui::GetStyle().Colors[ImGuiCol_Text] = ImGuiStyle().Colors[ImGuiCol_Text];
 
-            ImGui::Text("Frame time: %8llu microseconds", elapsedNanoseconds / 1000);
+            ImGui::Text("Frame time: %8llu microseconds (frame %llu, %llu frames ago)",
+                (unsigned long long)(lastFrameTiming.ElapsedNanoseconds / 1000), (unsigned long long)lastFrameTiming.FrameNumber, (unsigned long long)(frameNumber - lastFrameTiming.FrameNumber));
+
+            uint64_t computeNanoseconds = lastFrameTiming.ComputeNanoseconds;
+            uint64_t depthPrepassNanoseconds = lastFrameTiming.DepthPrepassNanoseconds;
+            uint64_t drawNanoseconds = lastFrameTiming.DrawNanoseconds;
+            if (computeNanoseconds != 0)
+            {
+                ImGui::Text("  Compute:       %8llu microseconds", (unsigned long long)(computeNanoseconds / 1000));
+            }
+            if (depthPrepassNanoseconds != 0)
+            {
+                ImGui::Text("  Depth prepass: %8llu microseconds", (unsigned long long)(depthPrepassNanoseconds / 1000));
+            }
+            if (computeNanoseconds != 0 || depthPrepassNanoseconds != 0)
+            {
+                ImGui::Text("  Draw:          %8llu microseconds", (unsigned long long)(drawNanoseconds / 1000));
+            }
+
+            if (lastFrameTiming.HasPipelineStatistics)
+            {
+                const buddha::PipelineStatistics& statistics = lastFrameTiming.Statistics;
+                ImGui::Text("Vertices submitted: %10llu   VS invocations: %10llu (%.3f per vertex)",
+                    (unsigned long long)statistics.VerticesSubmitted, (unsigned long long)statistics.VertexShaderInvocations,
+                    statistics.VerticesSubmitted == 0 ? 0.0 : double(statistics.VertexShaderInvocations) / double(statistics.VerticesSubmitted));
+                ImGui::Text("Primitives submitted: %8llu   Clipping input primitives: %10llu   FS invocations: %10llu",
+                    (unsigned long long)statistics.PrimitivesSubmitted, (unsigned long long)statistics.ClippingInputPrimitives, (unsigned long long)statistics.FragmentShaderInvocations);
+            }
+
+            // compare against the plainest mode that reads the same OBJ-style data
+            static const int kComparisonChannelTolerance = 2;
+            if (ImGui::Button("Check against OBJ-style multi-index"))
+            {
+                pDemo->CompareModes(
+                    meshIDs[currMeshIndex],
+                    meshMatrices[currMeshIndex],
+                    screenWidth, screenHeight,
+                    (buddha::VertexPullingMode)currDemoMode,
+                    buddha::PULLER_OBJ_MODE,
+                    kComparisonChannelTolerance,
+                    &comparisonResult);
+                comparisonMode = currDemoMode;
+                comparisonMeshIndex = currMeshIndex;
+            }
+            if (comparisonMode == currDemoMode && comparisonMeshIndex == currMeshIndex)
+            {
+                ImGui::SameLine();
+                ImGui::Text("%s: %d / %d covered pixels differ (max channel difference %d)",
+                    comparisonResult.NumDifferentPixels == 0 ? "Match" : "MISMATCH",
+                    comparisonResult.NumDifferentPixels, comparisonResult.NumCoveredPixels, comparisonResult.MaxChannelDifference);
+            }
 
             ImGui::ListBox("Mesh", &currMeshIndex, meshDisplayNamesCStrs.data(), (int)meshDisplayNamesCStrs.size());
 
@@ -356,16 +740,71 @@ int main()
             bool wasBenchmarking = nowBenchmarking;
             ImGui::Checkbox("Benchmark", &nowBenchmarking);
 
-            if (ImGui::Button("Reset Benchmarks"))
+            // timings taken at different resolutions or with a different number of passes can't be compared, so changing these resets them
+            float renderScale = pDemo->GetRenderScale();
+            bool changedRenderScale = ImGui::SliderFloat("Render scale", &renderScale, 0.25f, 2.0f);
+            if (changedRenderScale)
             {
+                pDemo->SetRenderScale(renderScale);
+            }
+
+            bool depthPrepass = pDemo->GetDepthPrepass();
+            bool changedDepthPrepass = ImGui::Checkbox("Depth prepass", &depthPrepass);
+            if (changedDepthPrepass)
+            {
+                pDemo->SetDepthPrepass(depthPrepass);
+            }
+            if (depthPrepass && !buddha::IsDepthPrepassMode(currDemoMode))
+            {
+                ImGui::SameLine();
+                ImGui::Text("(not supported by this mode)");
+            }
+
+            bool changedPipelineStatistics = false;
+            if (pDemo->IsPipelineStatisticsSupported())
+            {
+                bool statisticsEnabled = pDemo->GetPipelineStatistics();
+                changedPipelineStatistics = ImGui::Checkbox("Pipeline statistics", &statisticsEnabled);
+                if (changedPipelineStatistics)
+                {
+                    pDemo->SetPipelineStatistics(statisticsEnabled);
+                }
+            }
+            else
+            {
+                ImGui::Text("Pipeline statistics: not supported (needs ARB_pipeline_statistics_query)");
+            }
+
+            if (ImGui::Button("Reset Benchmarks") || changedRenderScale || changedDepthPrepass || changedPipelineStatistics)
+            {
+                for (int i = 0; i < buddha::NUMBER_OF_MODES; i++)
+                {
+                    pipelineStatistics[i] = buddha::PipelineStatistics();
+                }
                 for (int i = 0; i < buddha::NUMBER_OF_MODES; i++)
                 {
                     totalTimes[i] = 0;
                     numTimes[i] = 0;
                 }
+                for (int i = 0; i < buddha::NUMBER_OF_MODES * buddha::NUMBER_OF_SOFT_VERTEX_CACHE_LOCK_STRATEGIES; i++)
+                {
+                    allLockStrategyTotalTimes[i] = 0;
+                    allLockStrategyNumTimes[i] = 0;
+                }
+                firstBenchmarkedFrameNumber = frameNumber + 1;
             }
 
-            if (currDemoMode == buddha::PULLER_OBJ_SOFTCACHE_MODE)
+            if (currDemoMode == buddha::FETCHER_DEDUPLICATED_MODE)
+            {
+                ImGui::Text("GPU-merged vertices: %d", pDemo->GetNumDeduplicatedVertices(meshIDs[currMeshIndex]));
+                if (ImGui::Button("Merge again"))
+                {
+                    pDemo->InvalidateDeduplicatedMesh(meshIDs[currMeshIndex]);
+                }
+                ImGui::Checkbox("Merge every frame (included in the frame time)", &rebuildDeduplicatedMeshEveryFrame);
+            }
+
+            if (buddha::IsSoftVertexCacheMode(currDemoMode))
             {
                 if (pDemo->GetSoftVertexCacheConfig().EnableCacheMissCounter)
                 {
@@ -376,30 +815,227 @@ int main()
                     ImGui::Text("Num vertex cache misses: %d / %d", numCacheMisses, totalNumVerts);
                 }
 
+                buddha::SoftVertexCacheInstrumentation instrumentation;
+                if (pDemo->GetSoftVertexCacheConfig().EnableCacheInstrumentation && pDemo->GetSoftVertexCacheInstrumentation(&instrumentation))
+                {
+                    ImGui::Text("Read lock failures: %d", instrumentation.ReadLockFailures);
+                    ImGui::Text("Write lock failures: %d", instrumentation.WriteLockFailures);
+                    ImGui::Text("Evictions: %d", instrumentation.Evictions);
+
+                    std::string wayHits;
+                    for (int hits : instrumentation.WayHits)
+                    {
+                        wayHits += " " + std::to_string(hits);
+                    }
+                    ImGui::Text("Hits per way (newest first):%s", wayHits.c_str());
+
+                    if (!instrumentation.BucketAccesses.empty())
+                    {
+                        int minAccesses = *std::min_element(instrumentation.BucketAccesses.begin(), instrumentation.BucketAccesses.end());
+                        int maxAccesses = *std::max_element(instrumentation.BucketAccesses.begin(), instrumentation.BucketAccesses.end());
+                        double totalAccesses = 0.0;
+                        for (int accesses : instrumentation.BucketAccesses)
+                        {
+                            totalAccesses += accesses;
+                        }
+                        ImGui::Text("Accesses per bucket: min %d, average %.2f, max %d", minAccesses, totalAccesses / instrumentation.BucketAccesses.size(), maxAccesses);
+                        DrawBucketHeatStrip(instrumentation.BucketAccesses, 20.0f);
+                    }
+                }
+
                 buddha::SoftVertexCacheConfig cacheConfig = pDemo->GetSoftVertexCacheConfig();
                 bool updatedConfig = false;
                 updatedConfig |= ImGui::Checkbox("Count cache misses (affects perf.)", &cacheConfig.EnableCacheMissCounter);
+                updatedConfig |= ImGui::Checkbox("Cache instrumentation (affects perf.)", &cacheConfig.EnableCacheInstrumentation);
                 updatedConfig |= ImGui::SliderInt("Soft vertex cache bucket bits", &cacheConfig.NumCacheBucketBits, 1, 20);
                 updatedConfig |= ImGui::SliderInt("Soft vertex cache read lock attempts", &cacheConfig.NumReadCacheLockAttempts, 0, 1024);
                 updatedConfig |= ImGui::SliderInt("Soft vertex cache write lock attempts", &cacheConfig.NumWriteCacheLockAttempts, 0, 1024);
                 updatedConfig |= ImGui::SliderInt("Soft vertex cache entries per bucket", &cacheConfig.NumCacheEntriesPerBucket, 1, 10);
-                if (updatedConfig)
+
+                const char* vertexEncodingNames[buddha::NUMBER_OF_SOFT_VERTEX_CACHE_ENCODINGS] = {};
+                vertexEncodingNames[buddha::SOFT_VERTEX_CACHE_ENCODING_FULL] = "Full (48 bytes)";
+                vertexEncodingNames[buddha::SOFT_VERTEX_CACHE_ENCODING_CLIP_POSITION] = "Clip position + fp32 normal (28 bytes)";
+                vertexEncodingNames[buddha::SOFT_VERTEX_CACHE_ENCODING_CLIP_POSITION_OCTAHEDRAL_NORMAL] = "Clip position + octahedral normal (20 bytes)";
+                int vertexEncoding = cacheConfig.VertexEncoding;
+                if (ImGui::Combo("Soft vertex cache vertex encoding", &vertexEncoding, vertexEncodingNames, buddha::NUMBER_OF_SOFT_VERTEX_CACHE_ENCODINGS))
+                {
+                    cacheConfig.VertexEncoding = (buddha::SoftVertexCacheEncoding)vertexEncoding;
+                    updatedConfig = true;
+                }
+
+                // changing the lock strategy keeps the per-strategy times, since those are what's being compared.
+                bool updatedLockStrategy = false;
+                int lockStrategy = cacheConfig.LockStrategy;
+                if (ImGui::Combo("Soft vertex cache lock strategy", &lockStrategy, lockStrategyNames, buddha::NUMBER_OF_SOFT_VERTEX_CACHE_LOCK_STRATEGIES))
+                {
+                    cacheConfig.LockStrategy = (buddha::SoftVertexCacheLockStrategy)lockStrategy;
+                    updatedLockStrategy = true;
+                }
+                ImGui::Checkbox("Cycle through lock strategies", &cycleLockStrategies);
+
+                if (updatedConfig || updatedLockStrategy)
                 {
                     pDemo->SetSoftVertexCacheConfig(cacheConfig);
+                    firstBenchmarkedFrameNumber = frameNumber + 1;
+
+                    // the config is shared by all soft cache modes
+                    for (int i = 0; i < buddha::NUMBER_OF_MODES; i++)
+                    {
+                        if (buddha::IsSoftVertexCacheMode(i))
+                        {
+                            totalTimes[i] = 0;
+                            numTimes[i] = 0;
+                        }
+                    }
+                }
 
-                    totalTimes[buddha::PULLER_OBJ_SOFTCACHE_MODE] = 0;
-                    numTimes[buddha::PULLER_OBJ_SOFTCACHE_MODE] = 0;
+                if (updatedConfig)
+                {
+                    for (int i = 0; i < buddha::NUMBER_OF_MODES * buddha::NUMBER_OF_SOFT_VERTEX_CACHE_LOCK_STRATEGIES; i++)
+                    {
+                        allLockStrategyTotalTimes[i] = 0;
+                        allLockStrategyNumTimes[i] = 0;
+                    }
+                }
+
+                ImGui::Text("Average time per lock strategy:");
+                for (int i = 0; i < buddha::NUMBER_OF_SOFT_VERTEX_CACHE_LOCK_STRATEGIES; i++)
+                {
+                    uint64_t lastTime = lockStrategyNumTimes[i] == 0 ? 0 : lockStrategyTotalTimes[i] / lockStrategyNumTimes[i];
+                    ImGui::Text("  %-42s %8llu microseconds", lockStrategyNames[i], (unsigned long long)(lastTime / 1000));
+                }
+            }
+
+            if (ImGui::CollapsingHeader("GL calls"))
+            {
+                bool interceptGLCalls = buddha::GLCallTracer::IsInstalled();
+                if (ImGui::Checkbox("Intercept GL calls (adds some CPU overhead to every call)", &interceptGLCalls))
+                {
+                    if (interceptGLCalls)
+                        buddha::GLCallTracer::Install();
+                    else
+                        buddha::GLCallTracer::Uninstall();
+                }
+
+                ImGui::Text("Scene bindings: %s", pDemo->IsUsingMultiBind() ? "multi-bind ranges (GL 4.4)" : "one slot at a time");
+
+                const std::vector<buddha::GLCallStatistics>& glCallStatistics = buddha::GLCallTracer::GetLastFrameStatistics();
+
+                uint64_t totalCalls = 0;
+                uint64_t totalRedundantCalls = 0;
+                double totalMilliseconds = 0.0;
+                for (const buddha::GLCallStatistics& statistics : glCallStatistics)
+                {
+                    totalCalls += statistics.NumCalls;
+                    totalRedundantCalls += statistics.NumRedundantCalls;
+                    totalMilliseconds += statistics.CPUMilliseconds;
+                }
+
+                if (!glCallStatistics.empty())
+                {
+                    ImGui::Text("Last frame: %llu calls, %llu redundant binds, %.3f ms in the driver", (unsigned long long)totalCalls, (unsigned long long)totalRedundantCalls, totalMilliseconds);
+                    ImGui::Text("  %-48s %8s %10s %10s", "Function", "Calls", "Redundant", "CPU ms");
+                    for (const buddha::GLCallStatistics& statistics : glCallStatistics)
+                    {
+                        ImGui::Text("  %-48s %8llu %10llu %10.3f", statistics.Name, (unsigned long long)statistics.NumCalls, (unsigned long long)statistics.NumRedundantCalls, statistics.CPUMilliseconds);
+                    }
+                }
+            }
+
+            if (ImGui::CollapsingHeader("Memory barriers"))
+            {
+                std::vector<buddha::PassMemoryBarrier> barriers;
+                pDemo->GetLastSceneMemoryBarriers(&barriers);
+
+                for (const buddha::PassMemoryBarrier& barrier : barriers)
+                {
+                    ImGui::Text("  %-32s %s", barrier.PassName, buddha::GetMemoryBarrierBitsString(barrier.Bits).c_str());
+                }
+            }
+
+            if (ImGui::CollapsingHeader("Memory footprint"))
+            {
+                std::vector<buddha::BufferFootprint> buffers;
+                pDemo->GetMeshMemoryFootprint(meshIDs[currMeshIndex], &buffers);
+
+                uint64_t totalBytes = 0;
+                for (const buddha::BufferFootprint& buffer : buffers)
+                {
+                    ImGui::Text("  %-32s %10.3f MB", buffer.Name.c_str(), double(buffer.Bytes) / 1e6);
+                    totalBytes += buffer.Bytes;
+                }
+                ImGui::Text("  %-32s %10.3f MB", "Total", double(totalBytes) / 1e6);
+            }
+
+            // the profiled frame is a few frames old, since its GPU timestamps are read without waiting
+            if (ImGui::CollapsingHeader("Frame profiler"))
+            {
+                if (!traceWriter.IsOpen())
+                {
+                    if (ImGui::Button("Start trace"))
+                    {
+                        if (traceWriter.Open(kTracePath))
+                        {
+                            traceStartMilliseconds = pProfiler->GetCPUMilliseconds();
+                            tracedMode = -1;
+                            tracedMeshIndex = -1;
+                        }
+                        else
+                        {
+                            std::cerr << "Error: unable to open " << kTracePath << std::endl;
+                        }
+                    }
+                    ImGui::SameLine();
+                    ImGui::Text("Writes the profiled frames and the mode, mesh and soft vertex cache config changes to %s", kTracePath);
+                }
+                else
+                {
+                    if (ImGui::Button("Stop trace"))
+                    {
+                        traceWriter.Close();
+                    }
+                    ImGui::SameLine();
+                    ImGui::Text("%d frames written to %s", traceWriter.GetNumFramesWritten(), traceWriter.GetPath().c_str());
+                }
+
+                if (hasProfilerFrame)
+                {
+                    ImGui::Text("Frame %llu: %.3f ms CPU, %.3f ms GPU", (unsigned long long)lastProfilerFrame.FrameNumber, lastProfilerFrame.CPUMilliseconds, lastProfilerFrame.GPUMilliseconds);
+
+                    ImGui::Text("CPU");
+                    DrawProfilerTimeline(lastProfilerFrame, false);
+                    ImGui::Text("GPU");
+                    DrawProfilerTimeline(lastProfilerFrame, true);
+
+                    for (const buddha::ProfilerZone& zone : lastProfilerFrame.Zones)
+                    {
+                        char gpuTime[32] = "";
+                        if (zone.HasGPUTimes)
+                        {
+                            snprintf(gpuTime, sizeof(gpuTime), "%8.3f ms GPU", zone.GPUEndMilliseconds - zone.GPUBeginMilliseconds);
+                        }
+                        ImGui::Text("%*s%-*s %8.3f ms CPU %s", zone.Depth * 2, "", 24 - zone.Depth * 2, zone.Name, zone.CPUEndMilliseconds - zone.CPUBeginMilliseconds, gpuTime);
+                    }
                 }
             }
         }
         ImGui::End();
 
+        pProfiler->EndZone();
+
         // Render GUI
+        pProfiler->BeginZone("Render GUI");
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glViewport(0, 0, screenWidth, screenHeight);
         ImGui::Render();
+        pProfiler->EndZone();
 
+        pProfiler->BeginZone("Swap buffers");
        	glfwSwapBuffers(window);
+        pProfiler->EndZone();
+
+        pProfiler->EndFrame();
+        buddha::GLCallTracer::EndFrame();
 
         then = now;
 	}
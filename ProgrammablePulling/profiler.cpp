@@ -0,0 +1,215 @@
+/*
+ * profiler.cpp
+ *
+ *  Hierarchical CPU/GPU frame profiler
+ */
+
+#include "profiler.h"
+
+#include <cassert>
+
+namespace buddha {
+
+Profiler::Profiler()
+    : mCurrentFrame(0)
+    , mIsInFrame(false)
+    , mNextFrameNumber(0)
+    , mGPUEpoch(0)
+{
+}
+
+void Profiler::Init(int numFramesInFlight)
+{
+    mFrames.resize(numFramesInFlight);
+    for (FrameRecord& record : mFrames)
+    {
+        record.NumQueriesUsed = 0;
+        record.IsPending = false;
+    }
+
+    mCPUEpoch = std::chrono::steady_clock::now();
+    glGetInteger64v(GL_TIMESTAMP, &mGPUEpoch);
+}
+
+GLuint Profiler::allocateQuery(FrameRecord* pRecord)
+{
+    if (pRecord->NumQueriesUsed == (int)pRecord->Queries.size())
+    {
+        GLuint query;
+        glGenQueries(1, &query);
+        pRecord->Queries.push_back(query);
+    }
+
+    return pRecord->Queries[pRecord->NumQueriesUsed++];
+}
+
+double Profiler::millisecondsSinceFrameBegin() const
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mFrameBeginTime).count();
+}
+
+double Profiler::GetCPUMilliseconds() const
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mCPUEpoch).count();
+}
+
+// reads the GPU timestamps of a frame, and adds it to the completed frames.
+// returns false if they aren't available yet and wait is false.
+bool Profiler::readFrame(FrameRecord* pRecord, bool wait)
+{
+    if (!pRecord->IsPending)
+    {
+        return true;
+    }
+
+    // the frame's end timestamp is written after all the others
+    if (!wait)
+    {
+        GLuint available;
+        glGetQueryObjectuiv(pRecord->Queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            return false;
+        }
+    }
+
+    // the first two queries are the frame's own begin and end
+    GLuint64 frameBegin, frameEnd;
+    glGetQueryObjectui64v(pRecord->Queries[0], GL_QUERY_RESULT, &frameBegin);
+    glGetQueryObjectui64v(pRecord->Queries[1], GL_QUERY_RESULT, &frameEnd);
+    pRecord->Frame.GPUStartMilliseconds = double(GLint64(frameBegin) - mGPUEpoch) / 1e6;
+    pRecord->Frame.GPUMilliseconds = double(frameEnd - frameBegin) / 1e6;
+
+    for (size_t i = 0; i < pRecord->Frame.Zones.size(); i++)
+    {
+        ProfilerZone& zone = pRecord->Frame.Zones[i];
+        int queryIndex = pRecord->ZoneQueries[i];
+        if (queryIndex < 0)
+        {
+            continue;
+        }
+
+        GLuint64 begin, end;
+        glGetQueryObjectui64v(pRecord->Queries[queryIndex], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(pRecord->Queries[queryIndex + 1], GL_QUERY_RESULT, &end);
+        zone.GPUBeginMilliseconds = double(begin - frameBegin) / 1e6;
+        zone.GPUEndMilliseconds = double(end - frameBegin) / 1e6;
+    }
+
+    mCompletedFrames.push_back(pRecord->Frame);
+
+    pRecord->IsPending = false;
+    return true;
+}
+
+void Profiler::BeginFrame()
+{
+    assert(!mIsInFrame);
+
+    // oldest first, so the completed frames stay in order
+    for (size_t i = 0; i < mFrames.size(); i++)
+    {
+        if (!readFrame(&mFrames[(mCurrentFrame + i) % mFrames.size()], false))
+        {
+            break;
+        }
+    }
+
+    // only waits if the GPU is more than numFramesInFlight frames behind
+    FrameRecord& record = mFrames[mCurrentFrame];
+    readFrame(&record, true);
+
+    record.Frame.FrameNumber = mNextFrameNumber++;
+    record.Frame.Zones.clear();
+    record.ZoneQueries.clear();
+    record.NumQueriesUsed = 0;
+
+    // the frame's begin and end timestamps
+    glQueryCounter(allocateQuery(&record), GL_TIMESTAMP);
+    allocateQuery(&record);
+
+    mFrameBeginTime = std::chrono::steady_clock::now();
+    record.Frame.CPUStartMilliseconds = std::chrono::duration<double, std::milli>(mFrameBeginTime - mCPUEpoch).count();
+    mIsInFrame = true;
+}
+
+void Profiler::EndFrame()
+{
+    assert(mIsInFrame);
+    assert(mOpenZones.empty());
+
+    FrameRecord& record = mFrames[mCurrentFrame];
+    glQueryCounter(record.Queries[1], GL_TIMESTAMP);
+    record.Frame.CPUMilliseconds = millisecondsSinceFrameBegin();
+
+    record.IsPending = true;
+    mCurrentFrame = (mCurrentFrame + 1) % (int)mFrames.size();
+    mIsInFrame = false;
+}
+
+bool Profiler::BeginZone(const char* name, bool gpu)
+{
+    if (!mIsInFrame)
+    {
+        return false;
+    }
+
+    FrameRecord& record = mFrames[mCurrentFrame];
+
+    ProfilerZone zone = {};
+    zone.Name = name;
+    zone.Depth = (int)mOpenZones.size();
+    zone.HasGPUTimes = gpu;
+    zone.CPUBeginMilliseconds = millisecondsSinceFrameBegin();
+
+    int queryIndex = -1;
+    if (gpu)
+    {
+        queryIndex = record.NumQueriesUsed;
+        glQueryCounter(allocateQuery(&record), GL_TIMESTAMP);
+        allocateQuery(&record);
+    }
+
+    mOpenZones.push_back((int)record.Frame.Zones.size());
+    record.Frame.Zones.push_back(zone);
+    record.ZoneQueries.push_back(queryIndex);
+    return true;
+}
+
+void Profiler::EndZone()
+{
+    if (!mIsInFrame)
+    {
+        return;
+    }
+
+    assert(!mOpenZones.empty());
+
+    FrameRecord& record = mFrames[mCurrentFrame];
+
+    int zoneIndex = mOpenZones.back();
+    mOpenZones.pop_back();
+
+    ProfilerZone& zone = record.Frame.Zones[zoneIndex];
+    zone.CPUEndMilliseconds = millisecondsSinceFrameBegin();
+
+    int queryIndex = record.ZoneQueries[zoneIndex];
+    if (queryIndex >= 0)
+    {
+        glQueryCounter(record.Queries[queryIndex + 1], GL_TIMESTAMP);
+    }
+}
+
+bool Profiler::PollCompletedFrame(ProfilerFrame* pFrame)
+{
+    if (mCompletedFrames.empty())
+    {
+        return false;
+    }
+
+    *pFrame = mCompletedFrames.front();
+    mCompletedFrames.pop_front();
+    return true;
+}
+
+} /* namespace buddha */
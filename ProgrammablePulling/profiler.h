@@ -0,0 +1,116 @@
+/*
+ * profiler.h
+ *
+ *  Hierarchical CPU/GPU frame profiler
+ */
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <GL/glew.h>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace buddha {
+
+struct ProfilerZone
+{
+    const char* Name;               // must outlive the profiler, usually a string literal
+    int Depth;                      // 0 for the zones that aren't nested in another zone
+    double CPUBeginMilliseconds;    // relative to the start of the frame on the CPU
+    double CPUEndMilliseconds;
+    bool HasGPUTimes;
+    double GPUBeginMilliseconds;    // relative to the start of the frame on the GPU
+    double GPUEndMilliseconds;
+};
+
+struct ProfilerFrame
+{
+    uint64_t FrameNumber;
+    double CPUStartMilliseconds;        // since the profiler was initialized, on the CPU clock
+    double GPUStartMilliseconds;        // since the profiler was initialized, on the GPU clock
+    double CPUMilliseconds;
+    double GPUMilliseconds;
+    std::vector<ProfilerZone> Zones;    // in the order they were opened, so a zone's parent always comes before it
+};
+
+// Records nested zones with std::chrono::steady_clock on the CPU and GL_TIMESTAMP queries on the GPU.
+// The GPU timestamps are read a few frames later without waiting, like the timer queries of the demo.
+class Profiler
+{
+public:
+    Profiler();
+
+    void Init(int numFramesInFlight);
+
+    void BeginFrame();
+    void EndFrame();
+
+    // Zones opened outside of a frame are ignored, BeginZone returns false for them and EndZone does nothing.
+    // Zones that don't issue GL commands can skip the GPU timestamps.
+    bool BeginZone(const char* name, bool gpu = true);
+    void EndZone();
+
+    // Returns the oldest frame whose GPU timestamps have been read, or false if there is none.
+    // Doesn't wait for the GPU. Call it until it returns false to get all of them.
+    bool PollCompletedFrame(ProfilerFrame* pFrame);
+
+    // Milliseconds since the profiler was initialized, on the same clock as ProfilerFrame::CPUStartMilliseconds
+    double GetCPUMilliseconds() const;
+
+private:
+    struct FrameRecord
+    {
+        ProfilerFrame Frame;
+        std::vector<GLuint> Queries;        // allocated as needed, reused by later frames
+        std::vector<int> ZoneQueries;       // index of the begin query of each zone (end = begin + 1), -1 for CPU-only zones
+        int NumQueriesUsed;
+        bool IsPending;
+    };
+
+    GLuint allocateQuery(FrameRecord* pRecord);
+    bool readFrame(FrameRecord* pRecord, bool wait);
+    double millisecondsSinceFrameBegin() const;
+
+    std::vector<FrameRecord> mFrames;
+    int mCurrentFrame;
+    bool mIsInFrame;
+    uint64_t mNextFrameNumber;
+    std::chrono::steady_clock::time_point mFrameBeginTime;
+    std::vector<int> mOpenZones;
+
+    // CPU time and GPU timestamp when the profiler was initialized, which are considered to be the same moment
+    std::chrono::steady_clock::time_point mCPUEpoch;
+    GLint64 mGPUEpoch;
+
+    std::deque<ProfilerFrame> mCompletedFrames;
+};
+
+// Zone that ends at the end of the C++ scope
+class ProfilerScope
+{
+public:
+    ProfilerScope(Profiler* pProfiler, const char* name, bool gpu = true)
+        : mProfiler(pProfiler->BeginZone(name, gpu) ? pProfiler : NULL)
+    {
+    }
+
+    ~ProfilerScope()
+    {
+        if (mProfiler)
+            mProfiler->EndZone();
+    }
+
+    ProfilerScope(const ProfilerScope&) = delete;
+    ProfilerScope& operator=(const ProfilerScope&) = delete;
+
+private:
+    Profiler* mProfiler;
+};
+
+} /* namespace buddha */
+
+#endif /* PROFILER_H_ */
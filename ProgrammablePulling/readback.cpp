@@ -0,0 +1,125 @@
+/*
+ * readback.cpp
+ *
+ *  Asynchronous readback of small GPU-produced buffers (counters, statistics)
+ */
+
+#include "readback.h"
+
+#include <cassert>
+
+namespace buddha {
+
+GPUReadbackRing::GPUReadbackRing()
+    : mBuffer(0)
+    , mMappedData(NULL)
+    , mSlotSizeInBytes(0)
+    , mFirstSlot(0)
+    , mNumQueued(0)
+{
+}
+
+void GPUReadbackRing::Init(GLsizeiptr slotSizeInBytes, int numSlots)
+{
+    Release();
+
+    mSlotSizeInBytes = slotSizeInBytes;
+    mSlots.assign(numSlots, Slot());
+
+    // coherent, so the data can be read as soon as the fence is signaled without any barrier or flush
+    const GLbitfield kMapFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &mBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, mSlotSizeInBytes * numSlots, NULL, kMapFlags | GL_CLIENT_STORAGE_BIT);
+    mMappedData = (const uint8_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, mSlotSizeInBytes * numSlots, kMapFlags);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GPUReadbackRing::Release()
+{
+    for (Slot& slot : mSlots)
+    {
+        if (slot.Fence)
+        {
+            glDeleteSync(slot.Fence);
+        }
+    }
+    mSlots.clear();
+    mFirstSlot = 0;
+    mNumQueued = 0;
+
+    if (mBuffer)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &mBuffer);
+        mBuffer = 0;
+        mMappedData = NULL;
+    }
+}
+
+bool GPUReadbackRing::Enqueue(GLuint srcBuffer, GLsizeiptr sizeInBytes, uint64_t tag)
+{
+    assert(sizeInBytes <= mSlotSizeInBytes);
+
+    if (mNumQueued == (int)mSlots.size())
+    {
+        return false;
+    }
+
+    int slotIndex = (mFirstSlot + mNumQueued) % (int)mSlots.size();
+    Slot& slot = mSlots[slotIndex];
+
+    glBindBuffer(GL_COPY_READ_BUFFER, srcBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, slotIndex * mSlotSizeInBytes, sizeInBytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    slot.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.SizeInBytes = sizeInBytes;
+    slot.Tag = tag;
+
+    mNumQueued++;
+    return true;
+}
+
+const void* GPUReadbackRing::Peek(uint64_t* pTag, GLsizeiptr* pSizeInBytes)
+{
+    if (mNumQueued == 0)
+    {
+        return NULL;
+    }
+
+    Slot& slot = mSlots[mFirstSlot];
+
+    GLenum waitResult = glClientWaitSync(slot.Fence, 0, 0);
+    if (waitResult == GL_TIMEOUT_EXPIRED)
+    {
+        return NULL;
+    }
+    assert(waitResult == GL_ALREADY_SIGNALED || waitResult == GL_CONDITION_SATISFIED);
+
+    if (pTag)
+        *pTag = slot.Tag;
+    if (pSizeInBytes)
+        *pSizeInBytes = slot.SizeInBytes;
+
+    return mMappedData + mFirstSlot * mSlotSizeInBytes;
+}
+
+void GPUReadbackRing::Pop()
+{
+    assert(mNumQueued > 0);
+
+    Slot& slot = mSlots[mFirstSlot];
+    glDeleteSync(slot.Fence);
+    slot.Fence = 0;
+
+    mFirstSlot = (mFirstSlot + 1) % (int)mSlots.size();
+    mNumQueued--;
+}
+
+} /* namespace buddha */
@@ -0,0 +1,59 @@
+/*
+ * readback.h
+ *
+ *  Asynchronous readback of small GPU-produced buffers (counters, statistics)
+ */
+
+#ifndef READBACK_H_
+#define READBACK_H_
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace buddha {
+
+// Copies GPU-produced data into a persistently mapped ring buffer, and hands it back to the CPU once a fence says the copy is done.
+// Never waits for the GPU: the data arrives a few frames late, and a copy is dropped if all the slots are still in flight.
+class GPUReadbackRing
+{
+public:
+    // Like the other GL objects of the demo, the ring isn't released automatically.
+    GPUReadbackRing();
+
+    GPUReadbackRing(const GPUReadbackRing&) = delete;
+    GPUReadbackRing& operator=(const GPUReadbackRing&) = delete;
+
+    // (Re)allocates the ring, dropping any readback in flight.
+    void Init(GLsizeiptr slotSizeInBytes, int numSlots);
+    void Release();
+
+    // Queues a copy of the first sizeInBytes of srcBuffer. The tag comes back with the data to identify it.
+    // Returns false if the ring is full. The caller must have issued the barriers needed for the copy to see the data.
+    bool Enqueue(GLuint srcBuffer, GLsizeiptr sizeInBytes, uint64_t tag);
+
+    // Returns the oldest readback whose copy has completed, or NULL if there is none.
+    // The data stays valid until Pop is called.
+    const void* Peek(uint64_t* pTag, GLsizeiptr* pSizeInBytes);
+    void Pop();
+
+private:
+    struct Slot
+    {
+        GLsync Fence;
+        GLsizeiptr SizeInBytes;
+        uint64_t Tag;
+    };
+
+    GLuint mBuffer;
+    const uint8_t* mMappedData;
+    GLsizeiptr mSlotSizeInBytes;
+    std::vector<Slot> mSlots;
+    int mFirstSlot;     // oldest readback in flight
+    int mNumQueued;
+};
+
+} /* namespace buddha */
+
+#endif /* READBACK_H_ */
@@ -0,0 +1,28 @@
+layout(std140, binding = 0) uniform transform {
+    mat4 ModelViewMatrix;
+    mat4 ProjectionMatrix;
+    mat4 MVPMatrix;
+    mat4 InverseProjectionMatrix;
+} Transform;
+
+layout(std430, binding = 0) restrict readonly buffer PositionBuffer { vec4 Positions[]; };
+layout(std430, binding = 1) restrict readonly buffer NormalBuffer { vec4 Normals[]; };
+
+// captured with transform feedback in this order.
+// Keep this in sync with the TransformedVertex struct of pretransformed.vert
+out vec4 outViewPosition;
+out vec4 outViewNormal;
+out vec4 outClipPosition;
+
+void main(void) {
+
+    /* fetch attributes from storage buffer */
+    vec3 inVertexPosition = Positions[gl_VertexID].xyz;
+    vec3 inVertexNormal = Normals[gl_VertexID].xyz;
+
+    /* transform vertex and normal */
+    outViewPosition = Transform.ModelViewMatrix * vec4(inVertexPosition, 1);
+    outViewNormal = vec4(mat3(Transform.ModelViewMatrix) * inVertexNormal, 0);
+    outClipPosition = Transform.MVPMatrix * vec4(inVertexPosition, 1);
+
+}
@@ -0,0 +1,55 @@
+// One of PREPASS_FIXED_AOS, PREPASS_FIXED_SOA, PREPASS_SSBO_AOS, PREPASS_SSBO_SOA or PREPASS_OBJ is defined by the preamble,
+// matching the vertex array or the storage buffer bindings of the mode's main pass.
+// Only positions are read. gl_Position is invariant so the main pass can use GL_EQUAL depth testing.
+
+layout(std140, binding = 0) uniform transform {
+    mat4 ModelViewMatrix;
+    mat4 ProjectionMatrix;
+    mat4 MVPMatrix;
+} Transform;
+
+#if defined(PREPASS_FIXED_AOS)
+layout(location = 0) in vec3 inVertexPosition;
+#elif defined(PREPASS_FIXED_SOA)
+layout(location = 0) in float inPositionX;
+layout(location = 1) in float inPositionY;
+layout(location = 2) in float inPositionZ;
+#elif defined(PREPASS_SSBO_AOS)
+layout(std430, binding = 0) restrict readonly buffer IndexBuffer { uint Indices[]; };
+layout(std430, binding = 1) restrict readonly buffer PositionBuffer { vec4 Positions[]; };
+#elif defined(PREPASS_SSBO_SOA)
+layout(std430, binding = 0) restrict readonly buffer IndexBuffer { uint Indices[]; };
+layout(std430, binding = 1) restrict readonly buffer PositionXBuffer { float PositionXs[]; };
+layout(std430, binding = 2) restrict readonly buffer PositionYBuffer { float PositionYs[]; };
+layout(std430, binding = 3) restrict readonly buffer PositionZBuffer { float PositionZs[]; };
+#elif defined(PREPASS_OBJ)
+layout(std430, binding = 0) restrict readonly buffer PositionIndexBuffer { uint PositionIndices[]; };
+layout(std430, binding = 2) restrict readonly buffer PositionBuffer { vec4 Positions[]; };
+#endif
+
+out gl_PerVertex{
+    vec4 gl_Position;
+};
+
+invariant gl_Position;
+
+void main(void) {
+
+    /* fetch position */
+#if defined(PREPASS_FIXED_AOS)
+    vec3 position = inVertexPosition;
+#elif defined(PREPASS_FIXED_SOA)
+    vec3 position = vec3(inPositionX, inPositionY, inPositionZ);
+#elif defined(PREPASS_SSBO_AOS)
+    vec3 position = Positions[Indices[gl_VertexID]].xyz;
+#elif defined(PREPASS_SSBO_SOA)
+    uint inIndex = Indices[gl_VertexID];
+    vec3 position = vec3(PositionXs[inIndex], PositionYs[inIndex], PositionZs[inIndex]);
+#elif defined(PREPASS_OBJ)
+    vec3 position = Positions[PositionIndices[gl_VertexID]].xyz;
+#endif
+
+    /* transform vertex */
+    gl_Position = Transform.MVPMatrix * vec4(position, 1);
+
+}
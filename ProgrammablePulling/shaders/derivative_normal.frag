@@ -0,0 +1,11 @@
+in vec3 outVertexPosition;
+
+layout(location = 0) out vec4 outColor;
+
+void main(void)
+{
+	// the view space position is linear across the triangle, so its screen space derivatives span the triangle's plane
+	vec3 faceNormal = cross(dFdx(outVertexPosition), dFdy(outVertexPosition));
+
+	outColor = shade(outVertexPosition, faceNormal);
+}
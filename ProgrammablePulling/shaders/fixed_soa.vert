@@ -18,6 +18,9 @@ out gl_PerVertex {
 	vec4 gl_Position;
 };
 
+// the depth prepass computes the same position, see depth_prepass.vert
+invariant gl_Position;
+
 void main(void)
 {
 	vec3 inVertexPosition = vec3(inPositionX, inPositionY, inPositionZ);
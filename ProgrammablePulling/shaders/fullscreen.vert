@@ -0,0 +1,11 @@
+out gl_PerVertex{
+    vec4 gl_Position;
+};
+
+void main(void) {
+
+    /* one triangle that covers the whole screen */
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+
+}
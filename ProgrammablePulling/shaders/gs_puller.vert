@@ -0,0 +1,6 @@
+// All the pulling happens in the geometry shader, one point per triangle.
+// This only exists because a vertex shader is required to draw.
+
+void main()
+{
+}
@@ -0,0 +1,10 @@
+// Lighting shared by common.frag and visibility_resolve.frag, loaded as their preamble
+
+vec4 shade(vec3 viewPosition, vec3 viewNormal)
+{
+	// lighting in view space
+	vec3 L = normalize(vec3(0) - viewPosition);
+	vec3 N = normalize(viewNormal);
+
+	return vec4(N * max(0, dot(N, L)), 1.0);
+}
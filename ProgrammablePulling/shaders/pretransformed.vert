@@ -0,0 +1,31 @@
+// Keep this in sync with pretransform.comp and capture.vert
+struct TransformedVertex
+{
+    vec4 ViewPosition;
+    vec4 ViewNormal;
+    vec4 ClipPosition;
+};
+
+layout(std430, binding = 0) restrict readonly buffer IndexBuffer { uint Indices[]; };
+layout(std430, binding = 1) restrict readonly buffer TransformedVertexBuffer { TransformedVertex TransformedVertices[]; };
+
+out vec3 outVertexPosition;
+out vec3 outVertexNormal;
+
+out gl_PerVertex{
+    vec4 gl_Position;
+};
+
+void main(void) {
+
+    /* fetch index from storage buffer */
+    uint inIndex = Indices[gl_VertexID];
+
+    /* the vertex was already transformed by the compute pass */
+    TransformedVertex inVertex = TransformedVertices[inIndex];
+
+    outVertexPosition = inVertex.ViewPosition.xyz;
+    outVertexNormal = inVertex.ViewNormal.xyz;
+    gl_Position = inVertex.ClipPosition;
+
+}
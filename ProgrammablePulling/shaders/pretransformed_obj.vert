@@ -0,0 +1,33 @@
+// Keep this in sync with pretransform_positions.comp
+struct TransformedPosition
+{
+    vec4 ViewPosition;
+    vec4 ClipPosition;
+};
+
+layout(std430, binding = 0) restrict readonly buffer PositionIndexBuffer { uint PositionIndices[]; };
+layout(std430, binding = 1) restrict readonly buffer NormalIndexBuffer { uint NormalIndices[]; };
+layout(std430, binding = 2) restrict readonly buffer TransformedPositionBuffer { TransformedPosition TransformedPositions[]; };
+layout(std430, binding = 3) restrict readonly buffer TransformedNormalBuffer { vec4 TransformedNormals[]; };
+
+out vec3 outVertexPosition;
+out vec3 outVertexNormal;
+
+out gl_PerVertex{
+    vec4 gl_Position;
+};
+
+void main(void) {
+
+    /* fetch index from storage buffer */
+    uint positionIndex = PositionIndices[gl_VertexID];
+    uint normalIndex = NormalIndices[gl_VertexID];
+
+    /* positions and normals were already transformed by the compute passes */
+    TransformedPosition inPosition = TransformedPositions[positionIndex];
+
+    outVertexPosition = inPosition.ViewPosition.xyz;
+    outVertexNormal = TransformedNormals[normalIndex].xyz;
+    gl_Position = inPosition.ClipPosition;
+
+}
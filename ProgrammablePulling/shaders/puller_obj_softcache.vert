@@ -2,8 +2,25 @@ layout(std140, binding = 0) uniform transform {
     mat4 ModelViewMatrix;
     mat4 ProjectionMatrix;
     mat4 MVPMatrix;
+    mat4 InverseProjectionMatrix;
 } Transform;
 
+// VERTEX_CACHE_ENCODING is one of the VERTEX_CACHE_ENCODING_* defined by the preamble, which also passes
+// VERTEX_CACHE_VERTEX_SIZE_IN_DWORDS, the size of a vertex in the VertexCache for that encoding and lock strategy.
+
+// Keep these in sync with SoftVertexCacheLockStrategy
+#define CACHE_LOCK_READERS_WRITER                               0
+#define CACHE_LOCK_TRY_ONCE                                     1
+#define CACHE_LOCK_TICKET                                       2
+#define CACHE_LOCK_EXPONENTIAL_BACKOFF                          3
+#define CACHE_LOCK_SEQLOCK                                      4
+#define CACHE_LOCK_WRITER_ONLY                                  5
+
+#define MAX_CACHE_LOCK_BACKOFF 64
+
+// with writer-only locking, the <position index, normal index> key is stored after the vertex itself.
+#define VERTEX_CACHE_KEY_OFFSET (VERTEX_CACHE_VERTEX_SIZE_IN_DWORDS - VERTEX_CACHE_KEY_SIZE_IN_DWORDS)
+
 struct CacheEntry
 {
     uint PositionIndex;
@@ -18,7 +35,8 @@ struct CacheBucket
     CacheEntry entries[NUM_CACHE_ENTRIES_PER_BUCKET];
 };
 
-// Keep this in sync with VERTEX_CACHE_ENTRY_SIZE_IN_DWORDS
+// The vertex as seen by the shader. How it is stored in the VertexCache depends on VERTEX_CACHE_ENCODING,
+// see load_cached_vertex/store_cached_vertex.
 struct CachedVertex
 {
     vec4 m_outVertexPosition;
@@ -26,13 +44,17 @@ struct CachedVertex
     vec4 m_gl_Position;
 };
 
+#ifdef SOFTCACHE_SINGLE_INDEX
+layout(std430, binding = 0) restrict readonly buffer IndexBuffer { uint Indices[]; };
+#else
 layout(std430, binding = 0) restrict readonly buffer PositionIndexBuffer { uint PositionIndices[]; };
 layout(std430, binding = 1) restrict readonly buffer NormalIndexBuffer { uint NormalIndices[]; };
+#endif
 layout(std430, binding = 2) restrict readonly buffer PositionBuffer { vec4 Positions[]; };
 layout(std430, binding = 3) restrict readonly buffer NormalBuffer{ vec4 Normals[]; };
 
 layout(std430, binding = 4) coherent volatile restrict buffer VertexCacheCounterBuffer { uint VertexCacheCounter; };
-layout(std430, binding = 5) coherent volatile restrict buffer VertexCacheBuffer { CachedVertex VertexCache[]; };
+layout(std430, binding = 5) coherent volatile restrict buffer VertexCacheBuffer { uint VertexCache[]; };
 layout(std430, binding = 6) coherent volatile restrict buffer CacheBucketsBuffer { CacheBucket CacheBuckets[]; };
 layout(std430, binding = 7) coherent volatile restrict buffer CacheBucketLocksBuffer { uint CacheBucketLocks[]; };
 
@@ -40,6 +62,18 @@ layout(std430, binding = 7) coherent volatile restrict buffer CacheBucketLocksBu
 layout(std430, binding = 8) restrict buffer CacheMissCountBuffer { uint CacheMissCounter; };
 #endif
 
+#ifdef ENABLE_CACHE_INSTRUMENTATION
+// Keep this in sync with BuddhaDemo::readbackSoftVertexCacheInstrumentation
+layout(std430, binding = 9) restrict buffer CacheInstrumentationBuffer {
+    uint ReadLockFailures;
+    uint WriteLockFailures;
+    uint Evictions;
+    uint _padding;
+    uint WayHits[NUM_CACHE_ENTRIES_PER_BUCKET];
+    uint BucketAccesses[];
+} CacheInstrumentation;
+#endif
+
 out vec3 outVertexPosition;
 out vec3 outVertexNormal;
 
@@ -49,9 +83,183 @@ out gl_PerVertex{
 
 CachedVertex recompute_vertex(uint positionIndex, uint normalIndex);
 
-CachedVertex lookup_vertex_cache(int hashID, uint positionIndex, uint normalIndex)
+vec2 octahedral_wrap(vec2 v)
 {
-    bool should_store = false;
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+uint encode_octahedral_normal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 p = n.z >= 0.0 ? n.xy : octahedral_wrap(n.xy);
+    return packSnorm2x16(p);
+}
+
+vec3 decode_octahedral_normal(uint packed)
+{
+    vec2 p = unpackSnorm2x16(packed);
+    vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    if (n.z < 0.0)
+    {
+        n.xy = octahedral_wrap(n.xy);
+    }
+    return normalize(n);
+}
+
+void store_cached_vertex(int address, CachedVertex vertex)
+{
+    int base = address * VERTEX_CACHE_VERTEX_SIZE_IN_DWORDS;
+
+    VertexCache[base + 0] = floatBitsToUint(vertex.m_gl_Position.x);
+    VertexCache[base + 1] = floatBitsToUint(vertex.m_gl_Position.y);
+    VertexCache[base + 2] = floatBitsToUint(vertex.m_gl_Position.z);
+    VertexCache[base + 3] = floatBitsToUint(vertex.m_gl_Position.w);
+
+#if VERTEX_CACHE_ENCODING == VERTEX_CACHE_ENCODING_FULL
+    VertexCache[base + 4] = floatBitsToUint(vertex.m_outVertexNormal.x);
+    VertexCache[base + 5] = floatBitsToUint(vertex.m_outVertexNormal.y);
+    VertexCache[base + 6] = floatBitsToUint(vertex.m_outVertexNormal.z);
+    VertexCache[base + 7] = floatBitsToUint(vertex.m_outVertexNormal.w);
+    VertexCache[base + 8] = floatBitsToUint(vertex.m_outVertexPosition.x);
+    VertexCache[base + 9] = floatBitsToUint(vertex.m_outVertexPosition.y);
+    VertexCache[base + 10] = floatBitsToUint(vertex.m_outVertexPosition.z);
+    VertexCache[base + 11] = floatBitsToUint(vertex.m_outVertexPosition.w);
+#elif VERTEX_CACHE_ENCODING == VERTEX_CACHE_ENCODING_CLIP_POSITION
+    VertexCache[base + 4] = floatBitsToUint(vertex.m_outVertexNormal.x);
+    VertexCache[base + 5] = floatBitsToUint(vertex.m_outVertexNormal.y);
+    VertexCache[base + 6] = floatBitsToUint(vertex.m_outVertexNormal.z);
+#elif VERTEX_CACHE_ENCODING == VERTEX_CACHE_ENCODING_CLIP_POSITION_OCTAHEDRAL_NORMAL
+    VertexCache[base + 4] = encode_octahedral_normal(vertex.m_outVertexNormal.xyz);
+#else
+#error unknown VERTEX_CACHE_ENCODING
+#endif
+}
+
+CachedVertex load_cached_vertex(int address)
+{
+    int base = address * VERTEX_CACHE_VERTEX_SIZE_IN_DWORDS;
+
+    CachedVertex vertex;
+    vertex.m_gl_Position = vec4(
+        uintBitsToFloat(VertexCache[base + 0]),
+        uintBitsToFloat(VertexCache[base + 1]),
+        uintBitsToFloat(VertexCache[base + 2]),
+        uintBitsToFloat(VertexCache[base + 3]));
+
+#if VERTEX_CACHE_ENCODING == VERTEX_CACHE_ENCODING_FULL
+    vertex.m_outVertexNormal = vec4(
+        uintBitsToFloat(VertexCache[base + 4]),
+        uintBitsToFloat(VertexCache[base + 5]),
+        uintBitsToFloat(VertexCache[base + 6]),
+        uintBitsToFloat(VertexCache[base + 7]));
+    vertex.m_outVertexPosition = vec4(
+        uintBitsToFloat(VertexCache[base + 8]),
+        uintBitsToFloat(VertexCache[base + 9]),
+        uintBitsToFloat(VertexCache[base + 10]),
+        uintBitsToFloat(VertexCache[base + 11]));
+#else
+#if VERTEX_CACHE_ENCODING == VERTEX_CACHE_ENCODING_CLIP_POSITION
+    vertex.m_outVertexNormal = vec4(
+        uintBitsToFloat(VertexCache[base + 4]),
+        uintBitsToFloat(VertexCache[base + 5]),
+        uintBitsToFloat(VertexCache[base + 6]),
+        0);
+#else
+    vertex.m_outVertexNormal = vec4(decode_octahedral_normal(VertexCache[base + 4]), 0);
+#endif
+
+    // the view-space position is not stored, so reconstruct it from the clip-space position.
+    vec4 viewPosition = Transform.InverseProjectionMatrix * vertex.m_gl_Position;
+    vertex.m_outVertexPosition = vec4(viewPosition.xyz / viewPosition.w, 1);
+#endif
+
+    return vertex;
+}
+
+// Returns the address of the matching entry in the bucket, or -1 if there is none.
+// Must be called with read access to the bucket (unless validated some other way).
+int find_cache_entry(int hashID, uint positionIndex, uint normalIndex, out int way)
+{
+    for (int e = 0; e < NUM_CACHE_ENTRIES_PER_BUCKET; e++)
+    {
+        if (CacheBuckets[hashID].entries[e].PositionIndex == positionIndex &&
+            CacheBuckets[hashID].entries[e].NormalIndex == normalIndex)
+        {
+            way = e;
+            return CacheBuckets[hashID].entries[e].Address;
+        }
+    }
+
+    way = -1;
+    return -1;
+}
+
+// Allocates a vertex in the cache and pushes an entry for it into the bucket's FIFO.
+// Must be called with write access to the bucket.
+void insert_cache_entry(int hashID, uint positionIndex, uint normalIndex, CachedVertex vertex)
+{
+    int newAddress = int(atomicAdd(VertexCacheCounter, 1));
+    store_cached_vertex(newAddress, vertex);
+
+#if CACHE_LOCK_STRATEGY == CACHE_LOCK_WRITER_ONLY
+    // readers don't lock, so they validate entries against the key stored with the vertex.
+    VertexCache[newAddress * VERTEX_CACHE_VERTEX_SIZE_IN_DWORDS + VERTEX_CACHE_KEY_OFFSET + 0] = positionIndex;
+    VertexCache[newAddress * VERTEX_CACHE_VERTEX_SIZE_IN_DWORDS + VERTEX_CACHE_KEY_OFFSET + 1] = normalIndex;
+
+    // make sure the vertex is visible before the entry pointing to it is published.
+    memoryBarrierBuffer();
+#endif
+
+#ifdef ENABLE_CACHE_INSTRUMENTATION
+    if (CacheBuckets[hashID].entries[NUM_CACHE_ENTRIES_PER_BUCKET - 1].Address >= 0)
+    {
+        atomicAdd(CacheInstrumentation.Evictions, 1);
+    }
+#endif
+
+    // push the cache entry into the FIFO
+    for (int fifoIdx = NUM_CACHE_ENTRIES_PER_BUCKET - 1; fifoIdx > 0; fifoIdx--)
+    {
+        CacheBuckets[hashID].entries[fifoIdx] = CacheBuckets[hashID].entries[fifoIdx - 1];
+    }
+
+#if CACHE_LOCK_STRATEGY == CACHE_LOCK_WRITER_ONLY
+    CacheBuckets[hashID].entries[0].PositionIndex = positionIndex;
+    CacheBuckets[hashID].entries[0].NormalIndex = normalIndex;
+    atomicExchange(CacheBuckets[hashID].entries[0].Address, newAddress);
+#else
+    CacheEntry newEntry;
+    newEntry.PositionIndex = positionIndex;
+    newEntry.NormalIndex = normalIndex;
+    newEntry.Address = newAddress;
+
+    CacheBuckets[hashID].entries[0] = newEntry;
+#endif
+}
+
+#if CACHE_LOCK_STRATEGY == CACHE_LOCK_READERS_WRITER || CACHE_LOCK_STRATEGY == CACHE_LOCK_TRY_ONCE || CACHE_LOCK_STRATEGY == CACHE_LOCK_EXPONENTIAL_BACKOFF
+
+#if CACHE_LOCK_STRATEGY == CACHE_LOCK_EXPONENTIAL_BACKOFF
+// Spins on a plain read of the lock until it looks available or the backoff runs out.
+void backoff_cache_lock(int hashID, inout int backoff, uint availableBelow)
+{
+    for (int i = 0; i < backoff; i++)
+    {
+        if (CacheBucketLocks[hashID] < availableBelow)
+        {
+            break;
+        }
+    }
+
+    backoff = min(backoff * 2, MAX_CACHE_LOCK_BACKOFF);
+}
+#endif
+
+bool try_lookup_cache(int hashID, uint positionIndex, uint normalIndex, out int address, out int way)
+{
+#if CACHE_LOCK_STRATEGY == CACHE_LOCK_EXPONENTIAL_BACKOFF
+    int backoff = 1;
+#endif
 
     for (int readAttempt = 0; readAttempt < NUM_READ_CACHE_LOCK_ATTEMPTS; readAttempt++)
     {
@@ -59,66 +267,240 @@ CachedVertex lookup_vertex_cache(int hashID, uint positionIndex, uint normalInde
         if (atomicAdd(CacheBucketLocks[hashID], 1) < MAX_SIMULTANEOUS_READERS)
         {
             // Acquired read access, see if the entry we want is there.
-            int address = -1;
-            for (int e = 0; e < NUM_CACHE_ENTRIES_PER_BUCKET; e++)
-            {
-                if (CacheBuckets[hashID].entries[e].PositionIndex == positionIndex &&
-                    CacheBuckets[hashID].entries[e].NormalIndex == normalIndex)
-                {
-                    address = CacheBuckets[hashID].entries[e].Address;
-                    break;
-                }
-            }
+            address = find_cache_entry(hashID, positionIndex, normalIndex, way);
 
             // Release the reader lock
             atomicAdd(CacheBucketLocks[hashID], -1);
+            return true;
+        }
+
+#if CACHE_LOCK_STRATEGY == CACHE_LOCK_EXPONENTIAL_BACKOFF
+        backoff_cache_lock(hashID, backoff, MAX_SIMULTANEOUS_READERS);
+#endif
+    }
 
-            if (address >= 0)
+    address = -1;
+    way = -1;
+    return false;
+}
+
+bool try_insert_cache(int hashID, uint positionIndex, uint normalIndex, CachedVertex vertex)
+{
+#if CACHE_LOCK_STRATEGY == CACHE_LOCK_EXPONENTIAL_BACKOFF
+    int backoff = 1;
+#endif
+
+    for (int writeAttempt = 0; writeAttempt < NUM_WRITE_CACHE_LOCK_ATTEMPTS; writeAttempt++)
+    {
+        // Try to acquire write ownership by saturating all possible reader slots
+        if (atomicCompSwap(CacheBucketLocks[hashID], 0, MAX_SIMULTANEOUS_READERS) == 0)
+        {
+            // Acquired the write lock, so allocate the vertex and put it in.
+            insert_cache_entry(hashID, positionIndex, normalIndex, vertex);
+
+            // Release the write lock
+            CacheBucketLocks[hashID] = 0;
+            return true;
+        }
+
+#if CACHE_LOCK_STRATEGY == CACHE_LOCK_EXPONENTIAL_BACKOFF
+        backoff_cache_lock(hashID, backoff, 1);
+#endif
+    }
+
+    return false;
+}
+
+#elif CACHE_LOCK_STRATEGY == CACHE_LOCK_TICKET
+
+// Each bucket has two lock words: the next ticket to hand out and the ticket currently being served.
+// A ticket can't be given back, so an invocation only takes one when it is served right away, which keeps the
+// attempts bounded like the other strategies: it is a plain lock once the queue is gone, with the ticket words as its state.
+// The critical section is inside the attempt loop so that invocations of the same warp can't deadlock.
+#define TICKET_NEXT(hashID) CacheBucketLocks[(hashID) * 2 + 0]
+#define TICKET_SERVING(hashID) CacheBucketLocks[(hashID) * 2 + 1]
+
+// Takes the ticket being served if nobody holds it
+bool try_take_ticket(int hashID)
+{
+    uint serving = TICKET_SERVING(hashID);
+    return atomicCompSwap(TICKET_NEXT(hashID), serving, serving + 1) == serving;
+}
+
+bool try_lookup_cache(int hashID, uint positionIndex, uint normalIndex, out int address, out int way)
+{
+    for (int readAttempt = 0; readAttempt < NUM_READ_CACHE_LOCK_ATTEMPTS; readAttempt++)
+    {
+        if (try_take_ticket(hashID))
+        {
+            address = find_cache_entry(hashID, positionIndex, normalIndex, way);
+
+            atomicAdd(TICKET_SERVING(hashID), 1);
+            return true;
+        }
+    }
+
+    address = -1;
+    way = -1;
+    return false;
+}
+
+bool try_insert_cache(int hashID, uint positionIndex, uint normalIndex, CachedVertex vertex)
+{
+    for (int writeAttempt = 0; writeAttempt < NUM_WRITE_CACHE_LOCK_ATTEMPTS; writeAttempt++)
+    {
+        if (try_take_ticket(hashID))
+        {
+            // somebody else might have inserted the vertex since the lookup.
+            int way;
+            if (find_cache_entry(hashID, positionIndex, normalIndex, way) < 0)
             {
-                // found a matching entry, so grab the vertex from the cache, and we're done.
-                return VertexCache[address];
+                insert_cache_entry(hashID, positionIndex, normalIndex, vertex);
             }
-            else
+
+            atomicAdd(TICKET_SERVING(hashID), 1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#elif CACHE_LOCK_STRATEGY == CACHE_LOCK_SEQLOCK
+
+// The lock word is a sequence number that is odd while a writer is modifying the bucket.
+// Readers don't write to the lock at all, they retry if the sequence number changed under them.
+bool try_lookup_cache(int hashID, uint positionIndex, uint normalIndex, out int address, out int way)
+{
+    for (int readAttempt = 0; readAttempt < NUM_READ_CACHE_LOCK_ATTEMPTS; readAttempt++)
+    {
+        uint sequence = CacheBucketLocks[hashID];
+        if ((sequence & 1) == 0)
+        {
+            address = find_cache_entry(hashID, positionIndex, normalIndex, way);
+
+            // make sure the entries were read before the sequence number is read again.
+            memoryBarrierBuffer();
+
+            if (CacheBucketLocks[hashID] == sequence)
             {
-                // didn't find a matching entry, so will try to write into it.
-                should_store = true;
+                return true;
             }
+        }
+    }
 
-            break;
+    address = -1;
+    way = -1;
+    return false;
+}
+
+bool try_insert_cache(int hashID, uint positionIndex, uint normalIndex, CachedVertex vertex)
+{
+    for (int writeAttempt = 0; writeAttempt < NUM_WRITE_CACHE_LOCK_ATTEMPTS; writeAttempt++)
+    {
+        uint sequence = CacheBucketLocks[hashID];
+        if ((sequence & 1) == 0 && atomicCompSwap(CacheBucketLocks[hashID], sequence, sequence + 1) == sequence)
+        {
+            // make sure readers can see the odd sequence number before any entry changes.
+            memoryBarrierBuffer();
+
+            insert_cache_entry(hashID, positionIndex, normalIndex, vertex);
+
+            // make sure the entries are written before readers can see the new sequence number.
+            memoryBarrierBuffer();
+
+            atomicExchange(CacheBucketLocks[hashID], sequence + 2);
+            return true;
         }
     }
 
+    return false;
+}
+
+#elif CACHE_LOCK_STRATEGY == CACHE_LOCK_WRITER_ONLY
+
+// Readers don't lock at all. Entries may be torn while a writer is shifting the FIFO,
+// so a matching entry is only trusted if the key stored with the vertex it points to also matches.
+bool try_lookup_cache(int hashID, uint positionIndex, uint normalIndex, out int address, out int way)
+{
+    address = find_cache_entry(hashID, positionIndex, normalIndex, way);
+
+    if (address >= 0)
+    {
+        if (VertexCache[address * VERTEX_CACHE_VERTEX_SIZE_IN_DWORDS + VERTEX_CACHE_KEY_OFFSET + 0] != positionIndex ||
+            VertexCache[address * VERTEX_CACHE_VERTEX_SIZE_IN_DWORDS + VERTEX_CACHE_KEY_OFFSET + 1] != normalIndex)
+        {
+            address = -1;
+        }
+    }
+
+    return true;
+}
+
+bool try_insert_cache(int hashID, uint positionIndex, uint normalIndex, CachedVertex vertex)
+{
+    for (int writeAttempt = 0; writeAttempt < NUM_WRITE_CACHE_LOCK_ATTEMPTS; writeAttempt++)
+    {
+        if (atomicCompSwap(CacheBucketLocks[hashID], 0, 1) == 0)
+        {
+            insert_cache_entry(hashID, positionIndex, normalIndex, vertex);
+
+            atomicExchange(CacheBucketLocks[hashID], 0);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#else
+#error unknown CACHE_LOCK_STRATEGY
+#endif
+
+CachedVertex lookup_vertex_cache(int hashID, uint positionIndex, uint normalIndex)
+{
+    bool should_store = false;
+
+#ifdef ENABLE_CACHE_INSTRUMENTATION
+    atomicAdd(CacheInstrumentation.BucketAccesses[hashID], 1);
+#endif
+
+    int address;
+    int way;
+    if (try_lookup_cache(hashID, positionIndex, normalIndex, address, way))
+    {
+        if (address >= 0)
+        {
+#ifdef ENABLE_CACHE_INSTRUMENTATION
+            atomicAdd(CacheInstrumentation.WayHits[way], 1);
+#endif
+
+            // found a matching entry, so grab the vertex from the cache, and we're done.
+            return load_cached_vertex(address);
+        }
+        else
+        {
+            // didn't find a matching entry, so will try to write into it.
+            should_store = true;
+        }
+    }
+    else
+    {
+#ifdef ENABLE_CACHE_INSTRUMENTATION
+        atomicAdd(CacheInstrumentation.ReadLockFailures, 1);
+#endif
+    }
+
     // couldn't find the entry in the cache, so we try to produce it ourselves to write it in.
     CachedVertex vertex = recompute_vertex(positionIndex, normalIndex);
 
     if (should_store)
     {
-        for (int writeAttempt = 0; writeAttempt < NUM_WRITE_CACHE_LOCK_ATTEMPTS; writeAttempt++)
+        if (!try_insert_cache(hashID, positionIndex, normalIndex, vertex))
         {
-            // Try to acquire write ownership by saturating all possible reader slots
-            if (atomicCompSwap(CacheBucketLocks[hashID], 0, MAX_SIMULTANEOUS_READERS) == 0)
-            {
-                // Acquired the write lock, so allocate the vertex and put it in.
-                int newAddress = int(atomicAdd(VertexCacheCounter, 1));
-                VertexCache[newAddress] = vertex;
-
-                CacheEntry newEntry;
-                newEntry.PositionIndex = positionIndex;
-                newEntry.NormalIndex = normalIndex;
-                newEntry.Address = newAddress;
-
-                // push the cache entry into the FIFO
-                for (int fifoIdx = NUM_CACHE_ENTRIES_PER_BUCKET - 1; fifoIdx > 0; fifoIdx--)
-                {
-                    CacheBuckets[hashID].entries[fifoIdx] = CacheBuckets[hashID].entries[fifoIdx - 1];
-                }
-
-                CacheBuckets[hashID].entries[0] = newEntry;
-
-                // Release the write lock
-                CacheBucketLocks[hashID] = 0;
-                break;
-            }
+#ifdef ENABLE_CACHE_INSTRUMENTATION
+            atomicAdd(CacheInstrumentation.WriteLockFailures, 1);
+#endif
         }
     }
 
@@ -129,11 +511,19 @@ CachedVertex lookup_vertex_cache(int hashID, uint positionIndex, uint normalInde
 
 void main()
 {
+#ifdef SOFTCACHE_SINGLE_INDEX
+    /* fetch index from storage buffer, merged vertices use the same index for positions and normals */
+    uint positionIndex = Indices[gl_VertexID];
+    uint normalIndex = positionIndex;
+
+    int hashID = int(positionIndex) & (NUM_CACHE_BUCKETS - 1);
+#else
     /* fetch index from storage buffer */
     uint positionIndex = PositionIndices[gl_VertexID];
     uint normalIndex = NormalIndices[gl_VertexID];
 
     int hashID = int(positionIndex + 33 * normalIndex) & (NUM_CACHE_BUCKETS - 1);
+#endif
    
     CachedVertex vertex = lookup_vertex_cache(hashID, positionIndex, normalIndex);
 
@@ -0,0 +1,30 @@
+layout(std140, binding = 0) uniform transform {
+    mat4 ModelViewMatrix;
+    mat4 ProjectionMatrix;
+    mat4 MVPMatrix;
+} Transform;
+
+layout(std430, binding = 0) restrict readonly buffer IndexBuffer { uint Indices[]; };
+layout(std430, binding = 1) restrict readonly buffer PositionBuffer { vec4 Positions[]; };
+
+// no normal, derivative_normal.frag reconstructs it from the position
+out vec3 outVertexPosition;
+
+out gl_PerVertex{
+    vec4 gl_Position;
+};
+
+void main(void) {
+
+    /* fetch index from storage buffer */
+    uint inIndex = Indices[gl_VertexID];
+
+    /* fetch position from storage buffer */
+    vec3 inVertexPosition;
+    inVertexPosition.xyz = Positions[inIndex].xyz;
+
+    /* transform vertex */
+    outVertexPosition = (Transform.ModelViewMatrix * vec4(inVertexPosition, 1)).xyz;
+    gl_Position = Transform.MVPMatrix * vec4(inVertexPosition, 1);
+
+}
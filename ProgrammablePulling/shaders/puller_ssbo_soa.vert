@@ -19,6 +19,9 @@ out gl_PerVertex{
     vec4 gl_Position;
 };
 
+// the depth prepass computes the same position, see depth_prepass.vert
+invariant gl_Position;
+
 void main(void) {
 
     /* fetch index from storage buffer */
@@ -0,0 +1,115 @@
+// One of SUBGROUP_KHR, SUBGROUP_ARB or SUBGROUP_NV is defined by the preamble, depending on what the driver supports.
+#if defined(SUBGROUP_KHR)
+#extension GL_KHR_shader_subgroup_basic : require
+#extension GL_KHR_shader_subgroup_ballot : require
+#extension GL_KHR_shader_subgroup_shuffle : require
+#elif defined(SUBGROUP_ARB)
+#extension GL_ARB_gpu_shader_int64 : require
+#extension GL_ARB_shader_ballot : require
+#elif defined(SUBGROUP_NV)
+#extension GL_NV_shader_thread_group : require
+#extension GL_NV_shader_thread_shuffle : require
+#endif
+
+#if defined(SUBGROUP_KHR)
+#define SUBGROUP_INVOCATION_ID gl_SubgroupInvocationID
+#define SUBGROUP_READ_FIRST(value) subgroupBroadcastFirst(value)
+#define SUBGROUP_READ_INVOCATION(value, id) subgroupShuffle(value, id)
+#elif defined(SUBGROUP_ARB)
+#define SUBGROUP_INVOCATION_ID gl_SubGroupInvocationARB
+#define SUBGROUP_READ_FIRST(value) readFirstInvocationARB(value)
+#define SUBGROUP_READ_INVOCATION(value, id) readInvocationARB(value, id)
+#elif defined(SUBGROUP_NV)
+#define SUBGROUP_INVOCATION_ID gl_ThreadInWarpNV
+#define SUBGROUP_READ_FIRST(value) shuffleNV(value, uint(findLSB(ballotThreadNV(true))), gl_WarpSizeNV)
+#define SUBGROUP_READ_INVOCATION(value, id) shuffleNV(value, id, gl_WarpSizeNV)
+#endif
+
+layout(std140, binding = 0) uniform transform {
+    mat4 ModelViewMatrix;
+    mat4 ProjectionMatrix;
+    mat4 MVPMatrix;
+    mat4 InverseProjectionMatrix;
+} Transform;
+
+#ifdef SUBGROUP_OBJ
+layout(std430, binding = 0) restrict readonly buffer PositionIndexBuffer { uint PositionIndices[]; };
+layout(std430, binding = 1) restrict readonly buffer NormalIndexBuffer { uint NormalIndices[]; };
+layout(std430, binding = 2) restrict readonly buffer PositionBuffer { vec4 Positions[]; };
+layout(std430, binding = 3) restrict readonly buffer NormalBuffer { vec4 Normals[]; };
+#else
+layout(std430, binding = 0) restrict readonly buffer IndexBuffer { uint Indices[]; };
+layout(std430, binding = 1) restrict readonly buffer PositionBuffer { vec4 Positions[]; };
+layout(std430, binding = 2) restrict readonly buffer NormalBuffer { vec4 Normals[]; };
+#endif
+
+out vec3 outVertexPosition;
+out vec3 outVertexNormal;
+
+out gl_PerVertex{
+    vec4 gl_Position;
+};
+
+void main(void) {
+
+    /* fetch index from storage buffer */
+#ifdef SUBGROUP_OBJ
+    uint positionIndex = PositionIndices[gl_VertexID];
+    uint normalIndex = NormalIndices[gl_VertexID];
+#else
+    uint positionIndex = Indices[gl_VertexID];
+    uint normalIndex = positionIndex;
+#endif
+
+    /*
+     * find the first invocation in the subgroup that has the same vertex.
+     * each iteration retires all the invocations that share the vertex of the first remaining one,
+     * so the loop runs once per unique vertex in the subgroup.
+     */
+    uint leaderID;
+    for (;;)
+    {
+        uint firstPositionIndex = SUBGROUP_READ_FIRST(positionIndex);
+        uint firstNormalIndex = SUBGROUP_READ_FIRST(normalIndex);
+        uint firstID = SUBGROUP_READ_FIRST(SUBGROUP_INVOCATION_ID);
+        if (firstPositionIndex == positionIndex && firstNormalIndex == normalIndex)
+        {
+            leaderID = firstID;
+            break;
+        }
+    }
+
+    /* only the leaders fetch and transform their vertex */
+    vec3 vertexPosition = vec3(0.0);
+    vec3 vertexNormal = vec3(0.0);
+    vec4 clipPosition = vec4(0.0);
+    if (leaderID == SUBGROUP_INVOCATION_ID)
+    {
+        vec3 inVertexPosition = Positions[positionIndex].xyz;
+        vec3 inVertexNormal = Normals[normalIndex].xyz;
+
+        vertexPosition = (Transform.ModelViewMatrix * vec4(inVertexPosition, 1)).xyz;
+        vertexNormal = mat3(Transform.ModelViewMatrix) * inVertexNormal;
+        clipPosition = Transform.MVPMatrix * vec4(inVertexPosition, 1);
+    }
+
+    /*
+     * broadcast the leaders' results to the other invocations.
+     * ARB_shader_ballot needs a dynamically uniform invocation ID, so this goes through the leaders one at a time.
+     */
+    for (;;)
+    {
+        uint firstLeaderID = SUBGROUP_READ_FIRST(leaderID);
+        vec3 leaderVertexPosition = SUBGROUP_READ_INVOCATION(vertexPosition, firstLeaderID);
+        vec3 leaderVertexNormal = SUBGROUP_READ_INVOCATION(vertexNormal, firstLeaderID);
+        vec4 leaderClipPosition = SUBGROUP_READ_INVOCATION(clipPosition, firstLeaderID);
+        if (firstLeaderID == leaderID)
+        {
+            outVertexPosition = leaderVertexPosition;
+            outVertexNormal = leaderVertexNormal;
+            gl_Position = leaderClipPosition;
+            break;
+        }
+    }
+
+}
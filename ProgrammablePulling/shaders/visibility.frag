@@ -0,0 +1,11 @@
+// Keep this in sync with visibility_resolve.frag
+#define VISIBILITY_INSTANCE_SHIFT 26
+
+flat in int outInstanceID;
+
+layout(location = 0) out uint outVisibility;
+
+void main(void)
+{
+	outVisibility = (uint(outInstanceID) << VISIBILITY_INSTANCE_SHIFT) | uint(gl_PrimitiveID);
+}
@@ -0,0 +1,25 @@
+layout(std140, binding = 0) uniform transform {
+    mat4 ModelViewMatrix;
+    mat4 ProjectionMatrix;
+    mat4 MVPMatrix;
+} Transform;
+
+layout(std430, binding = 0) restrict readonly buffer PositionIndexBuffer { uint PositionIndices[]; };
+layout(std430, binding = 2) restrict readonly buffer PositionBuffer { vec4 Positions[]; };
+
+flat out int outInstanceID;
+
+out gl_PerVertex{
+    vec4 gl_Position;
+};
+
+void main(void) {
+
+    /* only the position is needed to find the visible triangles */
+    uint positionIndex = PositionIndices[gl_VertexID];
+    vec3 inVertexPosition = Positions[positionIndex].xyz;
+
+    outInstanceID = gl_InstanceID;
+    gl_Position = Transform.MVPMatrix * vec4(inVertexPosition, 1);
+
+}
@@ -0,0 +1,64 @@
+// Keep this in sync with visibility.frag
+#define VISIBILITY_INSTANCE_SHIFT 26
+// Keep this in sync with the clear value of the visibility buffer
+#define VISIBILITY_EMPTY 0xFFFFFFFFu
+
+layout(std140, binding = 0) uniform transform {
+    mat4 ModelViewMatrix;
+    mat4 ProjectionMatrix;
+    mat4 MVPMatrix;
+    mat4 InverseProjectionMatrix;
+} Transform;
+
+layout(std430, binding = 0) restrict readonly buffer PositionIndexBuffer { uint PositionIndices[]; };
+layout(std430, binding = 1) restrict readonly buffer NormalIndexBuffer { uint NormalIndices[]; };
+layout(std430, binding = 2) restrict readonly buffer PositionBuffer { vec4 Positions[]; };
+layout(std430, binding = 3) restrict readonly buffer NormalBuffer { vec4 Normals[]; };
+
+layout(binding = 0) uniform usampler2D VisibilityBuffer;
+
+layout(location = 0) out vec4 outColor;
+
+void main(void)
+{
+	uint visibility = texelFetch(VisibilityBuffer, ivec2(gl_FragCoord.xy), 0).r;
+	if (visibility == VISIBILITY_EMPTY)
+	{
+		discard;
+	}
+
+	// every instance uses the same transform here, so only the triangle ID is needed
+	uint triangleID = visibility & ((1u << VISIBILITY_INSTANCE_SHIFT) - 1u);
+
+	/* pull and transform the triangle's vertices */
+	vec3 viewPositions[3];
+	vec3 viewNormals[3];
+	for (int i = 0; i < 3; i++)
+	{
+		uint positionIndex = PositionIndices[triangleID * 3 + i];
+		uint normalIndex = NormalIndices[triangleID * 3 + i];
+
+		viewPositions[i] = (Transform.ModelViewMatrix * vec4(Positions[positionIndex].xyz, 1)).xyz;
+		viewNormals[i] = mat3(Transform.ModelViewMatrix) * Normals[normalIndex].xyz;
+	}
+
+	/* intersect the view ray through the pixel with the triangle to get perspective-correct barycentrics */
+	vec2 ndc = gl_FragCoord.xy / vec2(textureSize(VisibilityBuffer, 0)) * 2.0 - 1.0;
+	vec4 farPoint = Transform.InverseProjectionMatrix * vec4(ndc, 1.0, 1.0);
+	vec3 rayDirection = farPoint.xyz / farPoint.w;
+
+	vec3 edge1 = viewPositions[1] - viewPositions[0];
+	vec3 edge2 = viewPositions[2] - viewPositions[0];
+	vec3 toOrigin = -viewPositions[0];
+	vec3 p = cross(rayDirection, edge2);
+	vec3 q = cross(toOrigin, edge1);
+	float invDeterminant = 1.0 / dot(edge1, p);
+	float u = dot(toOrigin, p) * invDeterminant;
+	float v = dot(rayDirection, q) * invDeterminant;
+	vec3 barycentrics = vec3(1.0 - u - v, u, v);
+
+	vec3 viewPosition = barycentrics.x * viewPositions[0] + barycentrics.y * viewPositions[1] + barycentrics.z * viewPositions[2];
+	vec3 viewNormal = barycentrics.x * viewNormals[0] + barycentrics.y * viewNormals[1] + barycentrics.z * viewNormals[2];
+
+	outColor = shade(viewPosition, viewNormal);
+}
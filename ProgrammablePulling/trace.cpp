@@ -0,0 +1,191 @@
+/*
+ * trace.cpp
+ *
+ *  Writes profiled frames and events to a Chrome trace_event JSON file
+ */
+
+#include "trace.h"
+#include "profiler.h"
+
+#include <iomanip>
+
+namespace buddha {
+
+// thread IDs of the tracks in the trace
+enum TraceTrack
+{
+    TRACE_TRACK_CPU = 1,
+    TRACE_TRACK_GPU = 2
+};
+
+static std::string escapeJSONString(const std::string& s)
+{
+    std::string escaped;
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            escaped += ' ';
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+TraceWriter::TraceWriter()
+    : mHasEvents(false)
+    , mNumFramesWritten(0)
+{
+}
+
+TraceWriter::~TraceWriter()
+{
+    Close();
+}
+
+bool TraceWriter::Open(const char* path)
+{
+    Close();
+
+    mFile.open(path, std::ios::out | std::ios::trunc);
+    if (!mFile)
+    {
+        return false;
+    }
+
+    mPath = path;
+    mHasEvents = false;
+    mNumFramesWritten = 0;
+
+    // timestamps are in microseconds, with nanosecond precision
+    mFile << std::fixed << std::setprecision(3);
+    mFile << "[\n";
+
+    // names of the tracks
+    writeEventSeparator();
+    mFile << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"ProgrammablePulling\"}}";
+    writeEventSeparator();
+    mFile << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << TRACE_TRACK_CPU << ",\"args\":{\"name\":\"CPU\"}}";
+    writeEventSeparator();
+    mFile << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << TRACE_TRACK_GPU << ",\"args\":{\"name\":\"GPU\"}}";
+    mFile.flush();
+
+    return true;
+}
+
+void TraceWriter::Close()
+{
+    if (!mFile.is_open())
+    {
+        return;
+    }
+
+    mFile << "\n]\n";
+    mFile.close();
+}
+
+bool TraceWriter::IsOpen() const
+{
+    return mFile.is_open();
+}
+
+const std::string& TraceWriter::GetPath() const
+{
+    return mPath;
+}
+
+int TraceWriter::GetNumFramesWritten() const
+{
+    return mNumFramesWritten;
+}
+
+void TraceWriter::writeEventSeparator()
+{
+    if (mHasEvents)
+    {
+        mFile << ",\n";
+    }
+    mHasEvents = true;
+}
+
+void TraceWriter::writeArguments(const Arguments& args)
+{
+    mFile << "\"args\":{";
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (i > 0)
+        {
+            mFile << ",";
+        }
+        mFile << "\"" << escapeJSONString(args[i].first) << "\":\"" << escapeJSONString(args[i].second) << "\"";
+    }
+    mFile << "}";
+}
+
+void TraceWriter::writeCompleteEvent(const char* name, int track, double beginMilliseconds, double endMilliseconds, const Arguments& args)
+{
+    writeEventSeparator();
+    mFile << "{\"name\":\"" << escapeJSONString(name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << track
+          << ",\"ts\":" << beginMilliseconds * 1000.0 << ",\"dur\":" << (endMilliseconds - beginMilliseconds) * 1000.0 << ",";
+    writeArguments(args);
+    mFile << "}";
+}
+
+void TraceWriter::WriteFrame(const ProfilerFrame& frame)
+{
+    if (!IsOpen())
+    {
+        return;
+    }
+
+    std::string frameName = "Frame " + std::to_string(frame.FrameNumber);
+    Arguments frameArgs;
+    frameArgs.push_back(std::make_pair("frame", std::to_string(frame.FrameNumber)));
+
+    writeCompleteEvent(frameName.c_str(), TRACE_TRACK_CPU, frame.CPUStartMilliseconds, frame.CPUStartMilliseconds + frame.CPUMilliseconds, frameArgs);
+    writeCompleteEvent(frameName.c_str(), TRACE_TRACK_GPU, frame.GPUStartMilliseconds, frame.GPUStartMilliseconds + frame.GPUMilliseconds, frameArgs);
+
+    for (const ProfilerZone& zone : frame.Zones)
+    {
+        writeCompleteEvent(zone.Name, TRACE_TRACK_CPU,
+            frame.CPUStartMilliseconds + zone.CPUBeginMilliseconds,
+            frame.CPUStartMilliseconds + zone.CPUEndMilliseconds,
+            Arguments());
+
+        if (zone.HasGPUTimes)
+        {
+            writeCompleteEvent(zone.Name, TRACE_TRACK_GPU,
+                frame.GPUStartMilliseconds + zone.GPUBeginMilliseconds,
+                frame.GPUStartMilliseconds + zone.GPUEndMilliseconds,
+                Arguments());
+        }
+    }
+
+    mFile.flush();
+    mNumFramesWritten++;
+}
+
+void TraceWriter::WriteInstantEvent(const char* name, double timestampMilliseconds, const Arguments& args)
+{
+    if (!IsOpen())
+    {
+        return;
+    }
+
+    writeEventSeparator();
+    mFile << "{\"name\":\"" << escapeJSONString(name) << "\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":" << TRACE_TRACK_CPU
+          << ",\"ts\":" << timestampMilliseconds * 1000.0 << ",";
+    writeArguments(args);
+    mFile << "}";
+    mFile.flush();
+}
+
+} /* namespace buddha */
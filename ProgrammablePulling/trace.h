@@ -0,0 +1,56 @@
+/*
+ * trace.h
+ *
+ *  Writes profiled frames and events to a Chrome trace_event JSON file
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace buddha {
+
+struct ProfilerFrame;
+
+// Writes the JSON array format of the trace_event format, which chrome://tracing and Perfetto can open.
+// Every event is flushed as it is written, and the closing bracket is optional in this format,
+// so the file is still valid if the application exits without closing it.
+class TraceWriter
+{
+public:
+    typedef std::vector<std::pair<std::string, std::string>> Arguments;
+
+    TraceWriter();
+    ~TraceWriter();
+
+    bool Open(const char* path);
+    void Close();
+
+    bool IsOpen() const;
+    const std::string& GetPath() const;
+    int GetNumFramesWritten() const;
+
+    // Writes the CPU zones of the frame on the CPU track, and its GPU zones on the GPU track
+    void WriteFrame(const ProfilerFrame& frame);
+
+    // Writes an event that marks a moment on all tracks, like a mode switch
+    void WriteInstantEvent(const char* name, double timestampMilliseconds, const Arguments& args);
+
+private:
+    void writeEventSeparator();
+    void writeCompleteEvent(const char* name, int track, double beginMilliseconds, double endMilliseconds, const Arguments& args);
+    void writeArguments(const Arguments& args);
+
+    std::ofstream mFile;
+    std::string mPath;
+    bool mHasEvents;
+    int mNumFramesWritten;
+};
+
+} /* namespace buddha */
+
+#endif /* TRACE_H_ */
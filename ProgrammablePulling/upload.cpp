@@ -0,0 +1,120 @@
+/*
+ * upload.cpp
+ *
+ *  Streaming of small CPU-produced data (transforms, constants) to the GPU
+ */
+
+#include "upload.h"
+
+#include <cassert>
+#include <cstring>
+
+namespace buddha {
+
+GPUUploadRing::GPUUploadRing()
+    : mBuffer(0)
+    , mMappedData(NULL)
+    , mSegmentSizeInBytes(0)
+    , mAlignment(1)
+    , mCurrentSegment(-1)
+    , mNextSegment(0)
+    , mCurrentOffset(0)
+{
+}
+
+void GPUUploadRing::Init(GLsizeiptr segmentSizeInBytes, int numSegments, GLint alignment)
+{
+    Release();
+
+    assert(alignment >= 1 && segmentSizeInBytes % alignment == 0);
+
+    mSegmentSizeInBytes = segmentSizeInBytes;
+    mAlignment = alignment;
+    mSegmentFences.assign(numSegments, (GLsync)0);
+
+    // coherent, so the writes are visible to the GPU without any flush or barrier
+    const GLbitfield kMapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &mBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, mSegmentSizeInBytes * numSegments, NULL, kMapFlags);
+    mMappedData = (uint8_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, mSegmentSizeInBytes * numSegments, kMapFlags);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GPUUploadRing::Release()
+{
+    for (GLsync& fence : mSegmentFences)
+    {
+        if (fence)
+        {
+            glDeleteSync(fence);
+        }
+    }
+    mSegmentFences.clear();
+    mCurrentSegment = -1;
+    mNextSegment = 0;
+    mCurrentOffset = 0;
+
+    if (mBuffer)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &mBuffer);
+        mBuffer = 0;
+        mMappedData = NULL;
+    }
+}
+
+void GPUUploadRing::BeginSegment()
+{
+    assert(mCurrentSegment == -1);
+    assert(!mSegmentFences.empty());
+
+    mCurrentSegment = mNextSegment;
+    mNextSegment = (mNextSegment + 1) % (int)mSegmentFences.size();
+    mCurrentOffset = 0;
+
+    GLsync& fence = mSegmentFences[mCurrentSegment];
+    if (fence)
+    {
+        // the flush makes sure the fence gets signaled even if nothing else is submitted while waiting
+        GLenum waitResult;
+        do
+        {
+            waitResult = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        } while (waitResult == GL_TIMEOUT_EXPIRED);
+        assert(waitResult == GL_ALREADY_SIGNALED || waitResult == GL_CONDITION_SATISFIED);
+
+        glDeleteSync(fence);
+        fence = 0;
+    }
+}
+
+void GPUUploadRing::EndSegment()
+{
+    assert(mCurrentSegment != -1);
+
+    mSegmentFences[mCurrentSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    mCurrentSegment = -1;
+}
+
+GLintptr GPUUploadRing::Upload(const void* data, GLsizeiptr sizeInBytes)
+{
+    assert(mCurrentSegment != -1);
+
+    if (mCurrentOffset + sizeInBytes > mSegmentSizeInBytes)
+    {
+        return -1;
+    }
+
+    GLintptr offset = mCurrentSegment * mSegmentSizeInBytes + mCurrentOffset;
+    // write-only: the mapping is typically write-combined, so it must never be read back
+    memcpy(mMappedData + offset, data, sizeInBytes);
+
+    mCurrentOffset += (sizeInBytes + mAlignment - 1) / mAlignment * mAlignment;
+    return offset;
+}
+
+} /* namespace buddha */
@@ -0,0 +1,57 @@
+/*
+ * upload.h
+ *
+ *  Streaming of small CPU-produced data (transforms, constants) to the GPU
+ */
+
+#ifndef UPLOAD_H_
+#define UPLOAD_H_
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace buddha {
+
+// Writes CPU-produced data directly into a persistently mapped ring buffer, split in segments that are fenced once the
+// commands reading them have been issued. The CPU only waits if it comes back to a segment the GPU is still reading,
+// so it never stalls on the driver like glBufferSubData can, as long as there are enough segments in flight.
+class GPUUploadRing
+{
+public:
+    // Like the other GL objects of the demo, the ring isn't released automatically.
+    GPUUploadRing();
+
+    GPUUploadRing(const GPUUploadRing&) = delete;
+    GPUUploadRing& operator=(const GPUUploadRing&) = delete;
+
+    // (Re)allocates the ring. Every upload starts at a multiple of alignment, such as GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+    void Init(GLsizeiptr segmentSizeInBytes, int numSegments, GLint alignment);
+    void Release();
+
+    // Starts writing the next segment, first waiting for the GPU to be done with it if needed.
+    void BeginSegment();
+    // Fences the current segment. Call once all the commands that read its uploads have been issued.
+    void EndSegment();
+
+    // Copies data to the current segment and returns its offset in the buffer, or -1 if the segment is full.
+    // The mapping is coherent, so the data is visible to the commands issued after the call.
+    GLintptr Upload(const void* data, GLsizeiptr sizeInBytes);
+
+    GLuint GetBuffer() const { return mBuffer; }
+
+private:
+    GLuint mBuffer;
+    uint8_t* mMappedData;
+    GLsizeiptr mSegmentSizeInBytes;
+    GLint mAlignment;
+    std::vector<GLsync> mSegmentFences;     // 0 if the segment isn't in flight
+    int mCurrentSegment;                    // -1 outside of BeginSegment/EndSegment
+    int mNextSegment;
+    GLsizeiptr mCurrentOffset;              // within the current segment
+};
+
+} /* namespace buddha */
+
+#endif /* UPLOAD_H_ */